@@ -6,13 +6,49 @@
 
 
 
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#  define _GNU_SOURCE
+#endif
+
 #include <assert.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#if defined(_MSC_VER) && !defined(NO_THREADS)
+#  define NO_THREADS
+#endif
+#ifndef NO_THREADS
+#  include <pthread.h>
+#endif
+#ifdef _MSC_VER
+#  include <fcntl.h>
+#  include <io.h>
+#endif
+#ifdef __linux__
+#  include <dirent.h>
+#  include <errno.h>
+#  include <fcntl.h>
+#  include <linux/perf_event.h>
+#  include <sys/epoll.h>
+#  include <sys/eventfd.h>
+#  include <sys/inotify.h>
+#  include <sys/mman.h>
+#  include <sys/resource.h>
+#  include <sys/socket.h>
+#  include <sys/stat.h>
+#  include <sys/syscall.h>
+#  include <sys/un.h>
+#  include <unistd.h>
+#endif
+#if defined(__linux__) && defined(__x86_64__) && defined(__GNUC__)
+#  include <cpuid.h>
+#endif
 
 
 
@@ -150,412 +186,9401 @@ int size_t_mod_aug(size_t * const res, size_t const op) { return size_t_mod(res,
 int size_t_inc(size_t * const res) { return size_t_add_aug(res, 1); }
 int size_t_dec(size_t * const res) { return size_t_sub_aug(res, 1); }
 
+#ifdef _MSC_VER
+#  define SIZE_T_FORMAT "Iu"
+#else
+#  define SIZE_T_FORMAT "zu"
+#endif
 
 
-/*  Getting the size of a file
-
-    The following function appears to be either
-      - inefficient (ifdef SAFE_GET_FILE_SIZE) or
-      - possibly unsafe.
-    ("A binary stream need not meaningfully support fseek calls with a whence
-    value of SEEK_END.")
-    Future releases may improve the following function.
-*/
 
-int get_file_size(char const * const file_path, size_t * const file_size) {
-  size_t file_size_ = 0;
+int size_t_from_memory_string(size_t * const res, char const * const string) {
+  char number[32] = {0};
+  size_t length = strlen(string);
+  size_t unit = 1;
+  size_t res_ = 0;
   int ret = 0;
-  FILE * file = NULL;
 
-  file = fopen(file_path, "rb");
-  if (!file) {
+  if (length > 0) {
+    switch (string[length - 1]) {
+    case 'k': case 'K': unit = (size_t)1 << 10; break;
+    case 'm': case 'M': unit = (size_t)1 << 20; break;
+    case 'g': case 'G': unit = (size_t)1 << 30; break;
+    }
+  }
+  if (unit != 1) {
+    --length;
+  }
+  if ( length >= sizeof(number) ) {
     return 1;
   }
+  memcpy(number, string, length);
 
-#ifdef SAFE_GET_FILE_SIZE
-  while ( EOF != fgetc(file) ) {
-    ret = size_t_inc(&file_size_);
-    if (ret) {
-      fclose(file);
-      return 1;
-    }
+  ret = size_t_from_string(&res_, number);
+  if (ret) {
+    return ret;
   }
-  ret = feof(file);
-  if (!ret) {
-    fclose(file);
+  ret = size_t_mul_aug(&res_, unit);
+  if (ret) {
+    return ret;
+  }
+  *res = res_;
+  return 0;
+}
+
+
+
+/*  Threads
+
+    Threads are POSIX threads; thus, the program must be linked with -pthread.
+    If NO_THREADS is defined, thread_start runs the function to completion
+    instead, and thread_join does nothing.
+*/
+
+typedef struct {
+#ifndef NO_THREADS
+  pthread_t handle;
+#endif
+  int started;
+} thread;
+
+int thread_start(thread * const thread_,
+                 void * (* const function)(void *),
+                 void * const argument) {
+#ifndef NO_THREADS
+  if ( pthread_create(&thread_->handle, NULL, function, argument) ) {
     return 1;
   }
 #else
-  {
-    long int long_int = 0;
-
-    ret = fseek(file, 0, SEEK_END);
-    if (ret) {
-      fclose(file);
-      return 1;
-    }
+  function(argument);
+#endif
+  thread_->started = 1;
+  return 0;
+}
 
-    long_int = ftell(file);
-    if (long_int < 0 ||
-        long_int > SIZE_MAX)
-    {
-      fclose(file);
-      return 1;
-    }
-    file_size_ = long_int;
+void thread_join(thread * const thread_) {
+  if (thread_->started) {
+#ifndef NO_THREADS
+    pthread_join(thread_->handle, NULL);
+#endif
+    thread_->started = 0;
   }
+}
+
+
+
+/*  Timing
+
+    get_time returns the time in seconds since an arbitrary point; on Linux,
+    it is the monotonic wall clock. get_cpu_time returns the processor time in
+    seconds that the calling thread has used; elsewhere, that the process has.
+*/
+
+double get_time(void) {
+#ifdef __linux__
+  struct timespec time_;
+
+  clock_gettime(CLOCK_MONOTONIC, &time_);
+  return (double)time_.tv_sec + (double)time_.tv_nsec / 1e9;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
 #endif
+}
 
-  fclose(file);
-  *file_size = file_size_;
-  return 0;
+double get_cpu_time(void) {
+#ifdef __linux__
+  struct timespec time_;
+
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time_);
+  return (double)time_.tv_sec + (double)time_.tv_nsec / 1e9;
+#else
+  return (double)clock() / CLOCKS_PER_SEC;
+#endif
 }
 
 
 
-/*  struct buffer
+/*  Tracing
 
-    A buffer represents, in memory, the content of a file.
+    With --trace file, the program writes a timeline of its threads to the
+    file, in the trace event format of Chrome (chrome://tracing, Perfetto).
+    The spans are the tasks of the threads (an index of parallel_for, a task
+    of a pool); the waits for work and for the prefetched tile of a batch; the
+    stages of get_result (lower_bound, upper_bound, distance); the
+    tiles that a batch loads; and the phases of the statistics, where size and
+    read are file loads, and histogram, chunks and dp are kernels.
+
+    Each thread appends its spans to a buffer of its own, without locking;
+    only the registration of the buffer, once per thread, takes a lock. The
+    buffers outlive their threads and are written when the command has run.
+    Beyond TRACE_MAX_EVENTS spans, a thread drops spans and counts them. The
+    buffers come from the plain allocator, which the statistics do not count,
+    and tracing does not turn the statistics on: without --stats, the timers
+    of the phases only take the times of their spans. Like the statistics,
+    tracing compiles to nothing if NO_STATS is defined.
 */
 
+#define TRACE_MAX_EVENTS 1048576
+
+#ifndef NO_STATS
+
 typedef struct {
-  char * pointer;
-  size_t size;
-} buffer;
+  char const * name;
+  char const * category;
+  double begin;
+  double end;
+} trace_event;
 
-void buffer_destroy(buffer * const buffer_) {
-  if (buffer_) {
-    free(buffer_->pointer);
-  }
-  free(buffer_);
-}
+typedef struct trace_buffer {
+  trace_event * events;
+  size_t count;
+  size_t capacity;
+  size_t dropped;
+  size_t thread_id;
+  struct trace_buffer * next;
+} trace_buffer;
 
-int buffer_create(char const * const file_path,
-                  size_t const max_size,
-                  buffer ** const buffer_) {
-  buffer * buf = NULL;
-  int ret = 0;
-  FILE * file = NULL;
-  size_t fread_ = 0;
+typedef struct {
+  int enabled;
+  double origin;
+  size_t thread_count;
+  trace_buffer * buffers; /* all threads, the latest first */
+#ifndef NO_THREADS
+  pthread_mutex_t mutex;
+  pthread_key_t key; /* the buffer of each thread */
+#else
+  trace_buffer * buffer_;
+#endif
+} trace;
+
+trace trace_;
+
+/*  trace_get_buffer returns the buffer of the calling thread, which it
+    registers at the first call, or NULL if it could not allocate it.
+*/
 
+trace_buffer * trace_get_buffer(void) {
+  trace_buffer * buf = NULL;
+
+#ifndef NO_THREADS
+  buf = pthread_getspecific(trace_.key);
+#else
+  buf = trace_.buffer_;
+#endif
+  if (buf) {
+    return buf;
+  }
   buf = calloc( 1, sizeof(*buf) );
   if (!buf) {
-    return 1;
-  }
-  buf->pointer = NULL;
-  buf->size = 0;
-
-  ret = get_file_size(file_path, &buf->size);
-  if (ret) {
-    buffer_destroy(buf);
-    return ret;
+    return NULL;
   }
-  if (buf->size > max_size) {
-      buf->size = max_size;
+#ifndef NO_THREADS
+  if ( pthread_setspecific(trace_.key, buf) ) {
+    free(buf);
+    return NULL;
   }
+  pthread_mutex_lock(&trace_.mutex);
+#else
+  trace_.buffer_ = buf;
+#endif
+  buf->thread_id = trace_.thread_count++;
+  buf->next = trace_.buffers;
+  trace_.buffers = buf;
+#ifndef NO_THREADS
+  pthread_mutex_unlock(&trace_.mutex);
+#endif
+  return buf;
+}
 
-  if (buf->size) {
-    buf->pointer = calloc(1, buf->size);
-    if (!buf->pointer) {
-      buffer_destroy(buf);
-      return 1;
-    }
-  }
+/*  The thread that enables tracing is thread 0. */
 
-  file = fopen(file_path, "rb");
-  if (!file) {
-    buffer_destroy(buf);
-    return 1;
-  }
-  fread_ = fread(buf->pointer, 1, buf->size, file);
-  fclose(file);
-  if (fread_ != buf->size) {
-    buffer_destroy(buf);
+int trace_enable(void) {
+#ifndef NO_THREADS
+  if ( pthread_mutex_init(&trace_.mutex, NULL) ||
+       pthread_key_create(&trace_.key, NULL) ) {
     return 1;
   }
+#endif
+  trace_.origin = get_time();
+  trace_.enabled = 1;
+  return !trace_get_buffer();
+}
 
-  *buffer_ = buf;
-  return 0;
+double trace_now(void) {
+  return trace_.enabled ? get_time() : 0;
 }
 
+void trace_add(char const * const name,
+               char const * const category,
+               double const begin,
+               double const end) {
+  trace_buffer * buf = NULL;
+  trace_event * events = NULL;
+  size_t capacity = 0;
 
+  if (!trace_.enabled) {
+    return;
+  }
+  buf = trace_get_buffer();
+  if (!buf) {
+    return;
+  }
+  if (buf->count == buf->capacity) {
+    capacity = buf->capacity ? 2 * buf->capacity : 256;
+    if (capacity <= TRACE_MAX_EVENTS) {
+      events = realloc( buf->events, capacity * sizeof(*events) );
+    }
+    if (!events) {
+      ++buf->dropped;
+      return;
+    }
+    buf->events = events;
+    buf->capacity = capacity;
+  }
+  events = buf->events + buf->count++;
+  events->name = name;
+  events->category = category;
+  events->begin = begin;
+  events->end = end;
+}
 
-/* Computing the Levenshtein distance */
+/*  trace_write writes the spans of all threads, which must have finished
+    their work, to the file; then, it releases the buffers.
+*/
 
-int get_levenshtein_distance(buffer const * const buffer_1,
-                             buffer const * const buffer_2,
-                             size_t * const distance) {
-  int ret = 0;
-  buffer const * buf_small = NULL;
-  buffer const * buf_large = NULL;
+int trace_write(char const * const file_path) {
+  FILE * file = NULL;
+  trace_buffer * buf = NULL;
+  trace_event const * event = NULL;
+  size_t dropped = 0;
   size_t i = 0;
-  size_t j = 0;
-  size_t t = 0;
-  size_t * row_1 = NULL;
-  size_t * row_2 = NULL;
-  size_t * row_t = NULL;
+  int ret = 0;
 
-  if (buffer_1->size < buffer_2->size) {
-    buf_small = buffer_1;
-    buf_large = buffer_2;
+  file = fopen(file_path, "w");
+  ret = !file;
+  if (!ret) {
+    ret = fprintf(file, "{\"traceEvents\": [") < 0;
   }
-  else {
-    buf_small = buffer_2;
-    buf_large = buffer_1;
+  for (buf = trace_.buffers; !ret && buf; buf = buf->next) {
+    ret = fprintf(file,
+                  "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, "
+                  "\"tid\": %" SIZE_T_FORMAT ", \"args\": {\"name\": \"%s %"
+                  SIZE_T_FORMAT "\"}}",
+                  buf == trace_.buffers ? "" : ",", buf->thread_id,
+                  buf->thread_id ? "thread" : "main", buf->thread_id) < 0;
+    for (i = 0; !ret && i < buf->count; ++i) {
+      event = &buf->events[i];
+      ret = fprintf(file,
+                    ",\n{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", "
+                    "\"ts\": %.3f, \"dur\": %.3f, \"pid\": 1, \"tid\": %"
+                    SIZE_T_FORMAT "}",
+                    event->name, event->category,
+                    (event->begin - trace_.origin) * 1e6,
+                    (event->end - event->begin) * 1e6, buf->thread_id) < 0;
+    }
   }
-  assert(buf_small->size <= buf_large->size);
-  
-  ret = size_t_add(&i, buf_small->size, 1); /* (1) */
-  if (ret) {
-    return ret;
+  if (!ret) {
+    ret = fprintf(file, "\n], \"displayTimeUnit\": \"ms\"}\n") < 0;
   }
-  ret = size_t_mul_aug( &i, sizeof(size_t) );
-  if (ret) {
-    return ret;
+  if (file) {
+    ret = fclose(file) || ret;
   }
-  assert(i);
 
-  row_1 = calloc(1, i); /* indices: 0, ..., buf_small->size */
-  if (!row_1) {
-    return 1;
+  while (trace_.buffers) {
+    buf = trace_.buffers;
+    trace_.buffers = buf->next;
+    dropped += buf->dropped;
+    free(buf->events);
+    free(buf);
   }
-  row_2 = calloc(1, i); /* indices: see above */
-  if (!row_2) {
-    free(row_1);
-    return 1;
+  if (dropped) {
+    fprintf(stderr, "Warning: The trace dropped %" SIZE_T_FORMAT " spans.\n",
+            dropped);
   }
+  return ret;
+}
 
-  for (j = 0; j < buf_small->size + 1; ++j) { /* This is safe, since (1) succeeded. */
-    row_1[j] = j;
-  }
-  for (i = 0; i < buf_large->size; ++i) {
-    row_2[0] = i + 1;
+#  define TRACE_TIMER(begin) double begin = 0;
+#  define TRACE_START(begin) ((begin) = trace_now())
+#  define TRACE_STOP(begin, name, category) \
+     trace_add(name, category, begin, trace_now())
 
-    for (j = 0; j < buf_small->size; ++j) {
-      t = row_1[j];
-      if ( buf_small->pointer[j] !=
-           buf_large->pointer[i] ) {
-        ++t;
-      }
-      if (t > row_1[j + 1] + 1) {
-          t = row_1[j + 1] + 1;
-      }
-      if (t > row_2[j] + 1) {
-          t = row_2[j] + 1;
-      }
-      row_2[j + 1] = t;
-    }
+#else
 
-    row_t = row_1;
-    row_1 = row_2;
-    row_2 = row_t;
-  }
+#  define TRACE_TIMER(begin)
+#  define TRACE_START(begin) ((void)0)
+#  define TRACE_STOP(begin, name, category) ((void)0)
 
-  *distance = row_1[buf_small->size];
-  free(row_2);
-  free(row_1);
-  return 0;
-}
+#endif /* NO_STATS */
 
 
 
-/* Computing a lower bound on the Levenshtein distance */
+/*  Statistics
 
-size_t distance(size_t const size_1,
-                size_t const size_2) {
-  if (size_1 < size_2) {
-    return size_2 - size_1;
-  }
-  return size_1 - size_2;
-}
+    With --stats, the program reports on the standard error where its work
+    went, when the command has run: for each phase, the number of calls, their
+    wall clock time and their processor time; the bytes read, the cells of the
+    dynamic programming evaluated, the number and bytes of allocations, and
+    the peak resident set size. The phases are
+      size       querying the size of a file (get_file_size, mapping_create),
+      read       reading or mapping a file, or a block of a stream,
+      histogram  the histograms and sketches of the lower bound (get_ld_lb),
+      chunks     the chunk loops of the upper bounds (get_ld_ub), and
+      dp         the distances: bit-parallel, diagonal, scalar, weighted,
+                 in lanes, in the trie of many, of units and of searches,
+                 including those of the chunks, profiles and streams.
+    The times of a phase are summed over the threads; thus, they may exceed
+    the time of the run. Calls that fail are not counted. The cells of the
+    diagonal engine are its steps; the cells per second are the cells over the
+    dp wall clock time.
 
-int get_ld_lb(buffer const * const buffer_1,
-              buffer const * const buffer_2,
-              size_t * const bound) { /* lower bound */
-  size_t bound_ = 0;
-  int ret = 0;
-  size_t i = 0;
-  size_t t_1 = 0;
-  size_t t_2 = 0;
-  size_t freq_buf_1[256] = {0};
-  size_t freq_buf_2[256] = {0};
+    With --perf (on Linux), each timer also reads the hardware performance
+    counters of its thread, and the report adds, for each phase, the cycles,
+    the instructions, the instructions per cycle, the misses of the level 1
+    data cache and of the last level cache, and the branch misses; and, for
+    dp, these per cell. They tell whether the dynamic programming is bound by
+    computation or by memory. On the Intel processors that count them, the
+    report also adds the cycles that the core ran under the AVX frequency
+    licences 1 and 2, that is, at the lower clock that heavy AVX2 and light
+    AVX-512 instructions, or heavy AVX-512 instructions, require. The AVX2 and
+    AVX-512 clones of the kernels (see VECTOR_KERNEL) may cause them, and then
+    the cycles per cell understate the time per cell.
 
-  for (i = 0; i < buffer_1->size; ++i) {
-    unsigned char const unsigned_char = *(unsigned char const *)(buffer_1->pointer + i);
-    ++freq_buf_1[unsigned_char];
-  }
-  for (i = 0; i < buffer_2->size; ++i) {
-    unsigned char const unsigned_char = *(unsigned char const *)(buffer_2->pointer + i);
-    ++freq_buf_2[unsigned_char];
-  }
+    The layer consists of the macros STATS_TIMER, which declares a timer,
+    STATS_START, STATS_STOP and STATS_COUNT, and of stats_malloc, stats_calloc
+    and stats_realloc, which the code after this section calls instead of
+    malloc, calloc and realloc. If NO_STATS is defined, the macros compile to
+    nothing and the wrappers to the plain functions; otherwise, they cost a
+    branch unless --stats was given.
+*/
 
-  for (i = 0; i < 256; ++i) {
-    t_1 = distance( freq_buf_1[i],
-                    freq_buf_2[i] );
-    if (bound_ < t_1) {
-        bound_ = t_1;
-    }
-  }
+#define STATS_SIZE 0
+#define STATS_READ 1
+#define STATS_HISTOGRAM 2
+#define STATS_CHUNKS 3
+#define STATS_DP 4
+#define STATS_PHASE_COUNT 5
 
-  t_1 = 0;
-  for (i = 0; i < 256; ++i) {
-    t_2 = distance( freq_buf_1[i],
-                    freq_buf_2[i] );
-    ret = size_t_add_aug(&t_1, t_2);
-    if (ret) {
+#define STATS_BYTES_READ 0
+#define STATS_CELLS 1
+#define STATS_ALLOCATIONS 2
+#define STATS_ALLOCATED 3
+#define STATS_COUNTER_COUNT 4
+
+#define PERF_CYCLES 0
+#define PERF_INSTRUCTIONS 1
+#define PERF_L1_MISSES 2
+#define PERF_LLC_MISSES 3
+#define PERF_BRANCH_MISSES 4
+#define PERF_LICENSE_1 5
+#define PERF_LICENSE_2 6
+#define PERF_EVENT_COUNT 7
+
+#ifndef NO_STATS
+
+char const * const stats_phase_names[STATS_PHASE_COUNT] = {
+  "size", "read", "histogram", "chunks", "dp"
+};
+
+typedef struct {
+  double wall;
+  double cpu;
+  double events[PERF_EVENT_COUNT];
+} stats_timer;
+
+/*  Each thread adds to a record of its own, without locking; only the
+    registration of the record, once per thread, takes a lock. The records
+    outlive their threads, and stats_print sums them up.
+*/
+
+typedef struct stats_record {
+  size_t calls[STATS_PHASE_COUNT];
+  double wall[STATS_PHASE_COUNT];
+  double cpu[STATS_PHASE_COUNT];
+  double counters[STATS_COUNTER_COUNT]; /* doubles, since cells may overflow */
+  double events[STATS_PHASE_COUNT][PERF_EVENT_COUNT];
+  struct stats_record * next;
+} stats_record;
+
+typedef struct {
+  int enabled;
+  int perf;
+  int available[PERF_EVENT_COUNT];
+  stats_record * records; /* all threads */
+#ifndef NO_THREADS
+  pthread_mutex_t mutex;
+  pthread_key_t key; /* the record of each thread */
+#else
+  stats_record * record;
+#endif
+#if defined(__linux__) && !defined(NO_THREADS)
+  pthread_key_t perf_key; /* the counters of each thread */
+#endif
+} stats;
+
+stats stats_;
+
+/*  stats_get_record returns the record of the calling thread, which it
+    registers at the first call, or NULL if it could not allocate it.
+*/
+
+stats_record * stats_get_record(void) {
+  stats_record * record = NULL;
+
+#ifndef NO_THREADS
+  record = pthread_getspecific(stats_.key);
+#else
+  record = stats_.record;
+#endif
+  if (record) {
+    return record;
+  }
+  record = calloc( 1, sizeof(*record) );
+  if (!record) {
+    return NULL;
+  }
+#ifndef NO_THREADS
+  if ( pthread_setspecific(stats_.key, record) ) {
+    free(record);
+    return NULL;
+  }
+  pthread_mutex_lock(&stats_.mutex);
+#else
+  stats_.record = record;
+#endif
+  record->next = stats_.records;
+  stats_.records = record;
+#ifndef NO_THREADS
+  pthread_mutex_unlock(&stats_.mutex);
+#endif
+  return record;
+}
+
+#ifdef __linux__
+
+/*  Each thread opens its counters at its first timer; a thread of the pool
+    closes them when it exits. The counters only count in user space, which
+    perf_event_paranoid up to 2 permits. Many virtual machines provide none.
+    The counters of a thread form a group, so that one read returns all of
+    them. If the kernel multiplexes more events than the processor counts at
+    once, each count is scaled by the time the group was enabled over the time
+    it ran.
+*/
+
+typedef struct {
+  int fds[PERF_EVENT_COUNT];
+  int leader; /* the first open counter, or -1 */
+  size_t slots[PERF_EVENT_COUNT]; /* the positions in the group, or SIZE_MAX */
+  size_t count;
+} perf_counters;
+
+#ifdef NO_THREADS
+perf_counters * perf_counters_;
+#endif
+
+void perf_counters_destroy(void * const counters_) {
+  perf_counters * const counters = counters_;
+  size_t i = 0;
+
+  for (i = 0; i < PERF_EVENT_COUNT; ++i) {
+    if (counters->fds[i] >= 0) {
+      close(counters->fds[i]);
+    }
+  }
+  free(counters);
+}
+
+/*  The licence cycles have no generic event; they are the raw events
+    CORE_POWER.LVL1_TURBO_LICENSE and CORE_POWER.LVL2_TURBO_LICENSE (event
+    0x28, umasks 0x18 and 0x20) of the Intel cores from Skylake to Tiger Lake.
+    A raw event means something else on other processors, so that
+    perf_has_licenses only admits these models.
+*/
+
+int perf_has_licenses(void) {
+#if defined(__x86_64__) && defined(__GNUC__)
+  static unsigned int const models[] = {
+    0x4e, 0x5e, 0x8e, 0x9e, /* Skylake, Kaby Lake and Coffee Lake */
+    0x55, /* Skylake, Cascade Lake and Cooper Lake servers */
+    0x6a, 0x6c, 0x7d, 0x7e, /* Ice Lake */
+    0x8c, 0x8d /* Tiger Lake */
+  };
+  unsigned int eax = 0;
+  unsigned int ebx = 0;
+  unsigned int ecx = 0;
+  unsigned int edx = 0;
+  unsigned int model = 0;
+  size_t i = 0;
+
+  /* the vendor is "GenuineIntel" in ebx, edx and ecx */
+  if ( !__get_cpuid(0, &eax, &ebx, &ecx, &edx) || ebx != 0x756e6547 ||
+       edx != 0x49656e69 || ecx != 0x6c65746e ||
+       !__get_cpuid(1, &eax, &ebx, &ecx, &edx) || (eax >> 8 & 0xf) != 6 ) {
+    return 0;
+  }
+  model = (eax >> 4 & 0xf) | (eax >> 12 & 0xf0);
+  for (i = 0; i < sizeof(models) / sizeof(*models); ++i) {
+    if (model == models[i]) {
+      return 1;
+    }
+  }
+#endif
+  return 0;
+}
+
+int perf_open(size_t const event,
+              int const group_fd) {
+  static uint32_t const types[PERF_EVENT_COUNT] = {
+    PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+    PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE, PERF_TYPE_RAW, PERF_TYPE_RAW
+  };
+  static uint64_t const configs[PERF_EVENT_COUNT] = {
+    PERF_COUNT_HW_CPU_CYCLES,
+    PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_L1D | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+    PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+    PERF_COUNT_HW_CACHE_LL | PERF_COUNT_HW_CACHE_OP_READ << 8 |
+    PERF_COUNT_HW_CACHE_RESULT_MISS << 16,
+    PERF_COUNT_HW_BRANCH_MISSES,
+    0x28 | 0x18 << 8,
+    0x28 | 0x20 << 8
+  };
+  struct perf_event_attr attr;
+
+  if ( types[event] == PERF_TYPE_RAW && !perf_has_licenses() ) {
+    return -1;
+  }
+  memset( &attr, 0, sizeof(attr) );
+  attr.size = sizeof(attr);
+  attr.type = types[event];
+  attr.config = configs[event];
+  attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED |
+                     PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  return (int)syscall(SYS_perf_event_open, &attr, 0, -1, group_fd,
+                      PERF_FLAG_FD_CLOEXEC);
+}
+
+/*  perf_read stores the counts of the counters of the calling thread, or 0
+    for the events that are not available.
+*/
+
+void perf_read(double events[PERF_EVENT_COUNT]) {
+  perf_counters * counters = NULL;
+  uint64_t values[3 + PERF_EVENT_COUNT]; /* nr, enabled, running, the counts */
+  double scale = 1;
+  size_t i = 0;
+
+#ifndef NO_THREADS
+  counters = pthread_getspecific(stats_.perf_key);
+#else
+  counters = perf_counters_;
+#endif
+  if (!counters) {
+    counters = malloc( sizeof(*counters) );
+    if (counters) {
+      counters->leader = -1;
+      counters->count = 0;
+      for (i = 0; i < PERF_EVENT_COUNT; ++i) {
+        counters->fds[i] = -1;
+        counters->slots[i] = SIZE_MAX;
+        if (stats_.available[i]) {
+          counters->fds[i] = perf_open(i, counters->leader);
+        }
+        if (counters->fds[i] >= 0) {
+          if (counters->leader < 0) {
+            counters->leader = counters->fds[i];
+          }
+          counters->slots[i] = counters->count++;
+        }
+      }
+#ifndef NO_THREADS
+      if ( pthread_setspecific(stats_.perf_key, counters) ) {
+        perf_counters_destroy(counters);
+        counters = NULL;
+      }
+#else
+      perf_counters_ = counters;
+#endif
+    }
+  }
+  for (i = 0; i < PERF_EVENT_COUNT; ++i) {
+    events[i] = 0;
+  }
+  if ( !counters || counters->leader < 0 ||
+       read(counters->leader, values, sizeof(values)) <
+       (ssize_t)( (3 + counters->count) * sizeof(*values) ) ||
+       values[0] != counters->count ) {
+    return;
+  }
+  if (values[2] && values[2] < values[1]) {
+    scale = (double)values[1] / (double)values[2];
+  }
+  for (i = 0; i < PERF_EVENT_COUNT; ++i) {
+    if (counters->slots[i] != SIZE_MAX) {
+      events[i] = (double)values[3 + counters->slots[i]] * scale;
+    }
+  }
+}
+
+#endif /* __linux__ */
+
+/*  stats_enable starts collecting; with perf, also the hardware counters that
+    the processor provides.
+*/
+
+int stats_enable(int const perf) {
+#ifdef __linux__
+  size_t i = 0;
+  int fd = 0;
+#endif
+
+#ifndef NO_THREADS
+  if ( pthread_mutex_init(&stats_.mutex, NULL) ||
+       pthread_key_create(&stats_.key, NULL) ) {
+    return 1;
+  }
+#endif
+  if (perf) {
+#ifdef __linux__
+#  ifndef NO_THREADS
+    if ( pthread_key_create(&stats_.perf_key, perf_counters_destroy) ) {
+      return 1;
+    }
+#  endif
+    for (i = 0; i < PERF_EVENT_COUNT; ++i) {
+      fd = perf_open(i, -1);
+      if (fd >= 0) {
+        stats_.available[i] = 1;
+        stats_.perf = 1;
+        close(fd);
+      }
+    }
+#endif
+    if (!stats_.perf) {
+      fprintf(stderr, "Warning: Performance counters are not available.\n");
+    }
+  }
+  stats_.enabled = 1;
+  return 0;
+}
+
+/*  Without --stats, but with --trace, a timer only takes the times of the
+    span of its phase; it leaves the statistics alone.
+*/
+
+void stats_start(stats_timer * const timer) {
+  if (stats_.enabled) {
+#ifdef __linux__
+    if (stats_.perf) {
+      perf_read(timer->events);
+    }
+#endif
+    timer->wall = get_time();
+    timer->cpu = get_cpu_time();
+  }
+  else if (trace_.enabled) {
+    timer->wall = get_time();
+  }
+}
+
+void stats_stop(stats_timer const * const timer, size_t const phase) {
+  stats_record * record = NULL;
+  double wall = 0;
+  double cpu = 0;
+  double events[PERF_EVENT_COUNT] = {0};
+  size_t i = 0;
+
+  if (!stats_.enabled) {
+    if (trace_.enabled) {
+      trace_add(stats_phase_names[phase], phase <= STATS_READ ? "load" : "kernel",
+                timer->wall, get_time());
+    }
+    return;
+  }
+  wall = get_time() - timer->wall;
+  cpu = get_cpu_time() - timer->cpu;
+#ifdef __linux__
+  if (stats_.perf) {
+    perf_read(events);
+    for (i = 0; i < PERF_EVENT_COUNT; ++i) {
+      events[i] -= timer->events[i];
+    }
+  }
+#endif
+  record = stats_get_record();
+  if (record) {
+    ++record->calls[phase];
+    record->wall[phase] += wall;
+    record->cpu[phase] += cpu;
+    for (i = 0; i < PERF_EVENT_COUNT; ++i) {
+      record->events[phase][i] += events[i];
+    }
+  }
+  trace_add(stats_phase_names[phase], phase <= STATS_READ ? "load" : "kernel",
+            timer->wall, timer->wall + wall);
+}
+
+void stats_count(size_t const counter, double const amount) {
+  stats_record * record = NULL;
+
+  if (stats_.enabled) {
+    record = stats_get_record();
+    if (record) {
+      record->counters[counter] += amount;
+    }
+  }
+}
+
+void stats_allocate(double const size) {
+  stats_record * record = NULL;
+
+  if (stats_.enabled) {
+    record = stats_get_record();
+    if (record) {
+      ++record->counters[STATS_ALLOCATIONS];
+      record->counters[STATS_ALLOCATED] += size;
+    }
+  }
+}
+
+void * stats_malloc(size_t const size) {
+  stats_allocate(size);
+  return malloc(size);
+}
+
+void * stats_calloc(size_t const count, size_t const size) {
+  stats_allocate( (double)count * size );
+  return calloc(count, size);
+}
+
+void * stats_realloc(void * const pointer, size_t const size) {
+  stats_allocate(size);
+  return realloc(pointer, size);
+}
+
+/*  get_peak_memory stores the peak resident set size in bytes, if the
+    platform tells it.
+*/
+
+int get_peak_memory(double * const peak) {
+#ifdef __linux__
+  struct rusage usage;
+
+  if ( getrusage(RUSAGE_SELF, &usage) ) {
+    return 1;
+  }
+  *peak = (double)usage.ru_maxrss * 1024; /* in kibibytes */
+  return 0;
+#else
+  (void)peak;
+  return 1;
+#endif
+}
+
+/*  stats_print_events prints the counts of the events, divided by the
+    divisor, and the instructions per cycle if with_ipc. The events that are
+    not available are null in JSON, and left out otherwise.
+*/
+
+void stats_print_events(char const format,
+                        double const events[PERF_EVENT_COUNT],
+                        double const divisor,
+                        int const with_ipc) {
+  static char const * const keys[PERF_EVENT_COUNT] = {
+    "cycles", "instructions", "l1_misses", "llc_misses", "branch_misses",
+    "license_1_cycles", "license_2_cycles"
+  };
+  static char const * const names[PERF_EVENT_COUNT] = {
+    "cycles", "instructions", "L1 misses", "LLC misses", "branch misses",
+    "licence 1 cycles", "licence 2 cycles"
+  };
+  char const * separator = "";
+  int const has_ipc = stats_.available[PERF_CYCLES] &&
+                      stats_.available[PERF_INSTRUCTIONS] &&
+                      events[PERF_CYCLES] > 0;
+  size_t i = 0;
+
+  for (i = 0; i < PERF_EVENT_COUNT; ++i) {
+    if (format == 'j') {
+      fprintf(stderr, "%s\"%s\": ", i ? ", " : "", keys[i]);
+      if (stats_.available[i] && divisor > 0) {
+        fprintf(stderr, "%.6g", events[i] / divisor);
+      }
+      else {
+        fprintf(stderr, "null");
+      }
+    }
+    else if (stats_.available[i] && divisor > 0) {
+      fprintf(stderr, "%s %s %.6g", separator, names[i], events[i] / divisor);
+      separator = ",";
+    }
+  }
+  if (with_ipc) {
+    if (format == 'j' && has_ipc) {
+      fprintf(stderr, ", \"ipc\": %.4f",
+              events[PERF_INSTRUCTIONS] / events[PERF_CYCLES]);
+    }
+    else if (format == 'j') {
+      fprintf(stderr, ", \"ipc\": null");
+    }
+    else if (has_ipc) {
+      fprintf(stderr, "%s IPC %.4f", separator,
+              events[PERF_INSTRUCTIONS] / events[PERF_CYCLES]);
+    }
+  }
+}
+
+/*  stats_print reports in the format 'h' (human) or 'j' (JSON), when all
+    threads have finished their work.
+*/
+
+void stats_print(char const format) {
+  char const * const * const names = stats_phase_names;
+  stats_record total;
+  stats_record const * record = NULL;
+  double const * const counters = total.counters;
+  double cells_per_second = 0;
+  double peak = 0;
+  int peaked = 0;
+  size_t i = 0;
+  size_t j = 0;
+
+  memset( &total, 0, sizeof(total) );
+  for (record = stats_.records; record; record = record->next) {
+    for (i = 0; i < STATS_PHASE_COUNT; ++i) {
+      total.calls[i] += record->calls[i];
+      total.wall[i] += record->wall[i];
+      total.cpu[i] += record->cpu[i];
+      for (j = 0; j < PERF_EVENT_COUNT; ++j) {
+        total.events[i][j] += record->events[i][j];
+      }
+    }
+    for (i = 0; i < STATS_COUNTER_COUNT; ++i) {
+      total.counters[i] += record->counters[i];
+    }
+  }
+  if (total.wall[STATS_DP] > 0) {
+    cells_per_second = counters[STATS_CELLS] / total.wall[STATS_DP];
+  }
+  peaked = !get_peak_memory(&peak);
+  if (format == 'j') {
+    fprintf(stderr, "{\"phases\": {");
+    for (i = 0; i < STATS_PHASE_COUNT; ++i) {
+      fprintf(stderr,
+              "%s\"%s\": {\"calls\": %" SIZE_T_FORMAT ", \"wall\": %.6f, "
+              "\"cpu\": %.6f",
+              i ? ", " : "", names[i], total.calls[i], total.wall[i],
+              total.cpu[i]);
+      if (stats_.perf) {
+        fprintf(stderr, ", \"perf\": {");
+        stats_print_events(format, total.events[i], 1, 1);
+        fprintf(stderr, "}");
+      }
+      fprintf(stderr, "}");
+    }
+    fprintf(stderr, "}, ");
+    if (stats_.perf) {
+      fprintf(stderr, "\"per_cell\": {");
+      stats_print_events(format, total.events[STATS_DP], counters[STATS_CELLS],
+                         0);
+      fprintf(stderr, "}, ");
+    }
+    fprintf(stderr,
+            "\"bytes_read\": %.0f, \"cells\": %.0f, "
+            "\"cells_per_second\": %.0f, \"allocations\": %.0f, "
+            "\"allocated\": %.0f, \"peak_rss\": ",
+            counters[STATS_BYTES_READ], counters[STATS_CELLS], cells_per_second,
+            counters[STATS_ALLOCATIONS], counters[STATS_ALLOCATED]);
+    if (peaked) {
+      fprintf(stderr, "%.0f}\n", peak);
+    }
+    else {
+      fprintf(stderr, "null}\n");
+    }
+    return;
+  }
+  fprintf(stderr, "Stats: phase       calls      wall (s)       cpu (s)\n");
+  for (i = 0; i < STATS_PHASE_COUNT; ++i) {
+    fprintf(stderr, "Stats: %-9s %7" SIZE_T_FORMAT " %13.6f %13.6f\n",
+            names[i], total.calls[i], total.wall[i], total.cpu[i]);
+  }
+  for (i = 0; stats_.perf && i < STATS_PHASE_COUNT; ++i) {
+    if (total.calls[i]) {
+      fprintf(stderr, "Stats: perf %s:", names[i]);
+      stats_print_events(format, total.events[i], 1, 1);
+      fprintf(stderr, "\n");
+    }
+  }
+  if (stats_.perf && counters[STATS_CELLS] > 0) {
+    fprintf(stderr, "Stats: perf per cell:");
+    stats_print_events(format, total.events[STATS_DP], counters[STATS_CELLS], 0);
+    fprintf(stderr, "\n");
+  }
+  fprintf(stderr, "Stats: bytes read: %.0f\n", counters[STATS_BYTES_READ]);
+  fprintf(stderr, "Stats: cells: %.0f (%.4g per second)\n",
+          counters[STATS_CELLS], cells_per_second);
+  fprintf(stderr, "Stats: allocations: %.0f (%.0f bytes)\n",
+          counters[STATS_ALLOCATIONS], counters[STATS_ALLOCATED]);
+  if (peaked) {
+    fprintf(stderr, "Stats: peak resident set size: %.0f bytes\n", peak);
+  }
+}
+
+#  define STATS_TIMER(timer) stats_timer timer = {0};
+#  define STATS_START(timer) stats_start(&timer)
+#  define STATS_STOP(timer, phase) stats_stop(&timer, phase)
+#  define STATS_COUNT(counter, amount) stats_count(counter, amount)
+
+#else
+
+#  define STATS_TIMER(timer)
+#  define STATS_START(timer) ((void)0)
+#  define STATS_STOP(timer, phase) ((void)0)
+#  define STATS_COUNT(counter, amount) ((void)sizeof(amount))
+#  define stats_malloc(size) malloc(size)
+#  define stats_calloc(count, size) calloc(count, size)
+#  define stats_realloc(pointer, size) realloc(pointer, size)
+
+#endif /* NO_STATS */
+
+
+
+/*  Thread pools
+
+    A pool runs the submitted tasks on its threads, in the order in which they
+    were submitted. The submitter owns each task; a task must stay valid until
+    it has run. Without threads, pool_submit runs the task right away.
+*/
+
+typedef struct pool_task {
+  void (* run)(struct pool_task *);
+  struct pool_task * next;
+} pool_task;
+
+typedef struct {
+#ifndef NO_THREADS
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+#endif
+  pool_task * head;
+  pool_task * tail;
+  int stopping;
+  size_t thread_count;
+  thread * threads;
+} pool;
+
+size_t get_processor_count(void) {
+#ifdef __linux__
+  long int const count = sysconf(_SC_NPROCESSORS_ONLN);
+  if (count > 0) {
+    return (size_t)count;
+  }
+#endif
+  return 1;
+}
+
+void * pool_run(void * const pool_) {
+#ifndef NO_THREADS
+  pool * const poo = pool_;
+  pool_task * task = NULL;
+  TRACE_TIMER(begin)
+
+  for (;;) {
+    TRACE_START(begin);
+    pthread_mutex_lock(&poo->mutex);
+    while (!poo->head && !poo->stopping) {
+      pthread_cond_wait(&poo->cond, &poo->mutex);
+    }
+    task = poo->head;
+    if (task) {
+      poo->head = task->next;
+      if (!poo->head) {
+        poo->tail = NULL;
+      }
+    }
+    pthread_mutex_unlock(&poo->mutex);
+    TRACE_STOP(begin, "wait", "queue");
+    if (!task) {
+      break; /* The pool is stopping, and no task is left. */
+    }
+    TRACE_START(begin);
+    task->run(task);
+    TRACE_STOP(begin, "task", "task");
+  }
+#else
+  (void)pool_;
+#endif
+  return NULL;
+}
+
+/*  pool_destroy runs the remaining tasks before it returns. */
+
+void pool_destroy(pool * const pool_) {
+  size_t i = 0;
+
+  if (pool_) {
+#ifndef NO_THREADS
+    pthread_mutex_lock(&pool_->mutex);
+    pool_->stopping = 1;
+    pthread_cond_broadcast(&pool_->cond);
+    pthread_mutex_unlock(&pool_->mutex);
+#endif
+    for (i = 0; i < pool_->thread_count; ++i) {
+      thread_join(&pool_->threads[i]);
+    }
+#ifndef NO_THREADS
+    pthread_cond_destroy(&pool_->cond);
+    pthread_mutex_destroy(&pool_->mutex);
+#endif
+    free(pool_->threads);
+  }
+  free(pool_);
+}
+
+int pool_create(size_t const thread_count,
+                pool ** const pool_) {
+  pool * poo = NULL;
+  size_t i = 0;
+
+  poo = stats_calloc( 1, sizeof(*poo) );
+  if (!poo) {
+    return 1;
+  }
+#ifndef NO_THREADS
+  if ( pthread_mutex_init(&poo->mutex, NULL) ) {
+    free(poo);
+    return 1;
+  }
+  if ( pthread_cond_init(&poo->cond, NULL) ) {
+    pthread_mutex_destroy(&poo->mutex);
+    free(poo);
+    return 1;
+  }
+  poo->threads = stats_calloc( thread_count + 1, sizeof(*poo->threads) );
+  if (!poo->threads) {
+    pool_destroy(poo);
+    return 1;
+  }
+  for (i = 0; i < thread_count; ++i) {
+    if ( thread_start(&poo->threads[i], pool_run, poo) ) {
+      pool_destroy(poo);
+      return 1;
+    }
+    poo->thread_count = i + 1;
+  }
+#else
+  (void)thread_count;
+  (void)i;
+#endif
+
+  *pool_ = poo;
+  return 0;
+}
+
+void pool_submit(pool * const pool_,
+                 pool_task * const task) {
+  task->next = NULL;
+#ifndef NO_THREADS
+  pthread_mutex_lock(&pool_->mutex);
+  if (pool_->tail) {
+    pool_->tail->next = task;
+  }
+  else {
+    pool_->head = task;
+  }
+  pool_->tail = task;
+  pthread_cond_signal(&pool_->cond);
+  pthread_mutex_unlock(&pool_->mutex);
+#else
+  (void)pool_;
+  task->run(task);
+#endif
+}
+
+
+
+/*  parallel_for calls the function for each index below the count, on up to
+    thread_count threads. It fails if and only if a call fails; then, the
+    remaining indices may be skipped.
+*/
+
+typedef struct {
+  int (* function)(void *, size_t);
+  void * context;
+  size_t count;
+  size_t next;
+  int ret;
+#ifndef NO_THREADS
+  pthread_mutex_t mutex;
+#endif
+} parallel_loop;
+
+void * parallel_for_run(void * const loop_) {
+  parallel_loop * const loop = loop_;
+  size_t index = 0;
+  int ret = 0;
+  TRACE_TIMER(begin)
+
+  for (;;) {
+    TRACE_START(begin);
+#ifndef NO_THREADS
+    pthread_mutex_lock(&loop->mutex);
+#endif
+    index = loop->next;
+    if (!loop->ret && index < loop->count) {
+      ++loop->next;
+    }
+    else {
+      index = loop->count;
+    }
+#ifndef NO_THREADS
+    pthread_mutex_unlock(&loop->mutex);
+#endif
+    TRACE_STOP(begin, "wait", "queue");
+    if (index == loop->count) {
+      break;
+    }
+    TRACE_START(begin);
+    ret = loop->function(loop->context, index);
+    TRACE_STOP(begin, "task", "task");
+    if (ret) {
+#ifndef NO_THREADS
+      pthread_mutex_lock(&loop->mutex);
+#endif
+      loop->ret = ret;
+#ifndef NO_THREADS
+      pthread_mutex_unlock(&loop->mutex);
+#endif
+      break;
+    }
+  }
+  return NULL;
+}
+
+int parallel_for(size_t const count,
+                 size_t const thread_count,
+                 int (* const function)(void *, size_t),
+                 void * const context) {
+  parallel_loop loop;
+  thread * threads = NULL;
+  size_t started = 0;
+  size_t i = 0;
+
+  memset( &loop, 0, sizeof(loop) );
+  loop.function = function;
+  loop.context = context;
+  loop.count = count;
+#ifndef NO_THREADS
+  if ( pthread_mutex_init(&loop.mutex, NULL) ) {
+    return 1;
+  }
+  if (thread_count > 1 && count > 1) {
+    threads = stats_calloc( thread_count, sizeof(*threads) );
+  }
+  for (i = 0; threads && i + 1 < thread_count && i + 1 < count; ++i) {
+    if ( thread_start(&threads[i], parallel_for_run, &loop) ) {
+      break;
+    }
+    ++started;
+  }
+#else
+  (void)thread_count;
+#endif
+  parallel_for_run(&loop); /* The calling thread takes part, too. */
+  for (i = 0; i < started; ++i) {
+    thread_join(&threads[i]);
+  }
+  free(threads);
+#ifndef NO_THREADS
+  pthread_mutex_destroy(&loop.mutex);
+#endif
+  return loop.ret;
+}
+
+
+
+/*  Getting the size of a file
+
+    The following function appears to be either
+      - inefficient (ifdef SAFE_GET_FILE_SIZE) or
+      - possibly unsafe.
+    ("A binary stream need not meaningfully support fseek calls with a whence
+    value of SEEK_END.")
+    Future releases may improve the following function.
+*/
+
+int get_file_size(char const * const file_path, size_t * const file_size) {
+  size_t file_size_ = 0;
+  int ret = 0;
+  FILE * file = NULL;
+  STATS_TIMER(timer)
+
+  STATS_START(timer);
+  file = fopen(file_path, "rb");
+  if (!file) {
+    return 1;
+  }
+
+#ifdef SAFE_GET_FILE_SIZE
+  while ( EOF != fgetc(file) ) {
+    ret = size_t_inc(&file_size_);
+    if (ret) {
+      fclose(file);
+      return 1;
+    }
+  }
+  ret = feof(file);
+  if (!ret) {
+    fclose(file);
+    return 1;
+  }
+#else
+  {
+    long int long_int = 0;
+
+    ret = fseek(file, 0, SEEK_END);
+    if (ret) {
+      fclose(file);
+      return 1;
+    }
+
+    long_int = ftell(file);
+    if (long_int < 0 ||
+        long_int > SIZE_MAX)
+    {
+      fclose(file);
+      return 1;
+    }
+    file_size_ = long_int;
+  }
+#endif
+
+  fclose(file);
+  STATS_STOP(timer, STATS_SIZE);
+  *file_size = file_size_;
+  return 0;
+}
+
+
+
+/*  Hashing bytestrings
+
+    The following function computes a 128-bit hash of a bytestring.
+    It follows MurmurHash3 (x64, 128-bit variant) by Austin Appleby.
+    Blocks are loaded in native byte order; thus, hashes computed on
+    platforms of different endianness are not comparable.
+*/
+
+uint64_t uint64_rotl(uint64_t const op, int const shift) {
+  return (op << shift) | (op >> (64 - shift));
+}
+
+uint64_t uint64_fmix(uint64_t op) {
+  op ^= op >> 33;
+  op *= UINT64_C(0xff51afd7ed558ccd);
+  op ^= op >> 33;
+  op *= UINT64_C(0xc4ceb9fe1a85ec53);
+  op ^= op >> 33;
+  return op;
+}
+
+void hash_128(char const * const pointer,
+              size_t const size,
+              uint64_t hash[2]) {
+  uint64_t const c_1 = UINT64_C(0x87c37b91114253d5);
+  uint64_t const c_2 = UINT64_C(0x4cf5ad432745937f);
+  uint64_t h_1 = 0;
+  uint64_t h_2 = 0;
+  uint64_t k_1 = 0;
+  uint64_t k_2 = 0;
+  size_t i = 0;
+  size_t tail = 0;
+
+  for (i = 0; i + 16 <= size; i += 16) {
+    memcpy(&k_1, pointer + i,     8);
+    memcpy(&k_2, pointer + i + 8, 8);
+
+    k_1 *= c_1; k_1 = uint64_rotl(k_1, 31); k_1 *= c_2; h_1 ^= k_1;
+    h_1 = uint64_rotl(h_1, 27); h_1 += h_2; h_1 = h_1 * 5 + 0x52dce729;
+
+    k_2 *= c_2; k_2 = uint64_rotl(k_2, 33); k_2 *= c_1; h_2 ^= k_2;
+    h_2 = uint64_rotl(h_2, 31); h_2 += h_1; h_2 = h_2 * 5 + 0x38495ab5;
+  }
+
+  k_1 = 0;
+  k_2 = 0;
+  for (tail = size - i; tail > 8; --tail) {
+    k_2 ^= (uint64_t)(unsigned char)pointer[i + tail - 1] << (8 * (tail - 9));
+  }
+  for (; tail > 0; --tail) {
+    k_1 ^= (uint64_t)(unsigned char)pointer[i + tail - 1] << (8 * (tail - 1));
+  }
+  if (size - i > 8) {
+    k_2 *= c_2; k_2 = uint64_rotl(k_2, 33); k_2 *= c_1; h_2 ^= k_2;
+  }
+  if (size - i > 0) {
+    k_1 *= c_1; k_1 = uint64_rotl(k_1, 31); k_1 *= c_2; h_1 ^= k_1;
+  }
+
+  h_1 ^= (uint64_t)size;
+  h_2 ^= (uint64_t)size;
+  h_1 += h_2;
+  h_2 += h_1;
+  h_1 = uint64_fmix(h_1);
+  h_2 = uint64_fmix(h_2);
+  h_1 += h_2;
+  h_2 += h_1;
+
+  hash[0] = h_1;
+  hash[1] = h_2;
+}
+
+
+
+/*  struct buffer
+
+    A buffer represents, in memory, the content of a file.
+    Each buffer created by buffer_create carries the hash of its content.
+*/
+
+typedef struct {
+  char * pointer;
+  size_t size;
+  uint64_t hash[2];
+} buffer;
+
+void buffer_destroy(buffer * const buffer_) {
+  if (buffer_) {
+    free(buffer_->pointer);
+  }
+  free(buffer_);
+}
+
+int buffer_create(char const * const file_path,
+                  size_t const max_size,
+                  buffer ** const buffer_) {
+  buffer * buf = NULL;
+  int ret = 0;
+  FILE * file = NULL;
+  size_t fread_ = 0;
+  STATS_TIMER(timer)
+
+  buf = stats_calloc( 1, sizeof(*buf) );
+  if (!buf) {
+    return 1;
+  }
+  buf->pointer = NULL;
+  buf->size = 0;
+
+  ret = get_file_size(file_path, &buf->size);
+  if (ret) {
+    buffer_destroy(buf);
+    return ret;
+  }
+  if (buf->size > max_size) {
+      buf->size = max_size;
+  }
+
+  if (buf->size) {
+    buf->pointer = stats_calloc(1, buf->size);
+    if (!buf->pointer) {
+      buffer_destroy(buf);
+      return 1;
+    }
+  }
+
+  STATS_START(timer);
+  file = fopen(file_path, "rb");
+  if (!file) {
+    buffer_destroy(buf);
+    return 1;
+  }
+  fread_ = fread(buf->pointer, 1, buf->size, file);
+  fclose(file);
+  if (fread_ != buf->size) {
+    buffer_destroy(buf);
+    return 1;
+  }
+  STATS_STOP(timer, STATS_READ);
+  STATS_COUNT(STATS_BYTES_READ, fread_);
+  hash_128(buf->pointer, buf->size, buf->hash);
+
+  *buffer_ = buf;
+  return 0;
+}
+
+/*  Two buffers are identical if their contents are. The hashes only serve to
+    reject most unequal pairs quickly.
+*/
+
+int buffer_identical(buffer const * const buffer_1,
+                     buffer const * const buffer_2) {
+  if (buffer_1->size != buffer_2->size ||
+      buffer_1->hash[0] != buffer_2->hash[0] ||
+      buffer_1->hash[1] != buffer_2->hash[1]) {
+    return 0;
+  }
+  if (!buffer_1->size) {
+    return 1;
+  }
+  return !memcmp(buffer_1->pointer, buffer_2->pointer, buffer_1->size);
+}
+
+
+
+/*  struct file_list
+
+    A file list represents the paths that a list file contains, one per line.
+    Empty lines are ignored.
+*/
+
+typedef struct {
+  char * text;
+  char ** paths;
+  size_t count;
+} file_list;
+
+void file_list_destroy(file_list * const file_list_) {
+  if (file_list_) {
+    free(file_list_->paths);
+    free(file_list_->text);
+  }
+  free(file_list_);
+}
+
+int file_list_create(char const * const file_path,
+                     file_list ** const file_list_) {
+  file_list * list = NULL;
+  buffer * buf = NULL;
+  int ret = 0;
+  size_t i = 0;
+  size_t line_count = 0;
+  char * line = NULL;
+
+  ret = buffer_create(file_path, SIZE_MAX, &buf);
+  if (ret) {
+    return ret;
+  }
+
+  list = stats_calloc( 1, sizeof(*list) );
+  if (!list) {
+    buffer_destroy(buf);
+    return 1;
+  }
+  list->text = stats_calloc(1, buf->size + 1);
+  if (!list->text) {
+    file_list_destroy(list);
+    buffer_destroy(buf);
+    return 1;
+  }
+  memcpy(list->text, buf->pointer, buf->size);
+  for (i = 0; i < buf->size; ++i) {
+    if (list->text[i] == '\n') {
+      ++line_count;
+    }
+  }
+  list->paths = stats_calloc( line_count + 1, sizeof(*list->paths) );
+  if (!list->paths) {
+    file_list_destroy(list);
+    buffer_destroy(buf);
+    return 1;
+  }
+
+  line = list->text;
+  for (i = 0; i <= buf->size; ++i) {
+    if (list->text[i] == '\n' ||
+        list->text[i] == '\0') {
+      list->text[i] = '\0';
+      if (i > 0 && list->text + i > line && list->text[i - 1] == '\r') {
+        list->text[i - 1] = '\0';
+      }
+      if (*line) {
+        list->paths[list->count++] = line;
+      }
+      line = list->text + i + 1;
+    }
+  }
+  buffer_destroy(buf);
+
+  *file_list_ = list;
+  return 0;
+}
+
+
+
+/* Computing the Levenshtein distance */
+
+/*  levenshtein_row_step computes the row that follows row_1, for the given
+    byte of the other bytestring; the caller sets row_2[0].
+*/
+
+void levenshtein_row_step(size_t const * const row_1,
+                          size_t * const row_2,
+                          buffer const * const buffer_,
+                          char const byte) {
+  size_t j = 0;
+  size_t t = 0;
+
+  for (j = 0; j < buffer_->size; ++j) {
+    t = row_1[j];
+    if (buffer_->pointer[j] != byte) {
+      ++t;
+    }
+    if (t > row_1[j + 1] + 1) {
+        t = row_1[j + 1] + 1;
+    }
+    if (t > row_2[j] + 1) {
+        t = row_2[j] + 1;
+    }
+    row_2[j + 1] = t;
+  }
+}
+
+int get_levenshtein_distance(buffer const * const buffer_1,
+                             buffer const * const buffer_2,
+                             size_t * const distance) {
+  int ret = 0;
+  buffer const * buf_small = NULL;
+  buffer const * buf_large = NULL;
+  size_t i = 0;
+  size_t j = 0;
+  size_t * row_1 = NULL;
+  size_t * row_2 = NULL;
+  size_t * row_t = NULL;
+  STATS_TIMER(timer)
+
+  if (buffer_1->size < buffer_2->size) {
+    buf_small = buffer_1;
+    buf_large = buffer_2;
+  }
+  else {
+    buf_small = buffer_2;
+    buf_large = buffer_1;
+  }
+  assert(buf_small->size <= buf_large->size);
+  
+  ret = size_t_add(&i, buf_small->size, 1); /* (1) */
+  if (ret) {
+    return ret;
+  }
+  ret = size_t_mul_aug( &i, sizeof(size_t) );
+  if (ret) {
+    return ret;
+  }
+  assert(i);
+
+  row_1 = stats_calloc(1, i); /* indices: 0, ..., buf_small->size */
+  if (!row_1) {
+    return 1;
+  }
+  row_2 = stats_calloc(1, i); /* indices: see above */
+  if (!row_2) {
+    free(row_1);
+    return 1;
+  }
+  STATS_START(timer);
+
+  for (j = 0; j < buf_small->size + 1; ++j) { /* This is safe, since (1) succeeded. */
+    row_1[j] = j;
+  }
+  for (i = 0; i < buf_large->size; ++i) {
+    row_2[0] = i + 1;
+    levenshtein_row_step(row_1, row_2, buf_small, buf_large->pointer[i]);
+
+    row_t = row_1;
+    row_1 = row_2;
+    row_2 = row_t;
+  }
+
+  *distance = row_1[buf_small->size];
+  STATS_STOP(timer, STATS_DP);
+  STATS_COUNT(STATS_CELLS, (double)buf_small->size * buf_large->size);
+  free(row_2);
+  free(row_1);
+  return 0;
+}
+
+
+
+/*  Computing the Levenshtein distance bit-parallel
+
+    The following functions implement the block-based bit-vector algorithm of
+    Myers ("A fast bit-vector algorithm for approximate string matching based
+    on dynamic programming", 1999), for the distance between whole
+    bytestrings. One bytestring, the pattern, is represented by its match
+    masks: for each byte value c and each word w, the bits of
+    words[rows[c] * stride + w] mark the positions 64 * w, ..., 64 * w + 63 at
+    which the pattern contains c. The other bytestring, the text, is read byte
+    by byte; each column of the dynamic programming is represented by the signs
+    of its vertical differences, 64 rows per word.
+
+    The byte values that occur in the pattern (its alphabet) are numbered
+    densely, in ascending order, and all other byte values share one row of
+    zeros after them. Thus, the masks of a pattern with a small alphabet (DNA,
+    hex digits, base64) take a few rows instead of 256.
+*/
+
+typedef struct {
+  uint64_t * storage; /* owned; NULL if the words belong to someone else */
+  uint64_t const * words;
+  size_t stride;
+  size_t size; /* of the pattern */
+  size_t row_count; /* the size of the alphabet, plus the row of zeros */
+  size_t row_capacity;
+  unsigned char rows[256];
+} match_masks;
+
+size_t get_word_count(size_t const size) {
+  return size / 64 + (size % 64 != 0);
+}
+
+/*  set_rows numbers the byte values with nonzero counts densely, and gives the
+    others the row after them; it returns the number of rows.
+*/
+
+size_t set_rows(size_t const counts[256],
+                unsigned char rows[256]) {
+  size_t row_count = 0;
+  size_t i = 0;
+
+  for (i = 0; i < 256; ++i) {
+    if (counts[i]) {
+      rows[i] = (unsigned char)row_count++;
+    }
+  }
+  for (i = 0; i < 256; ++i) {
+    if (!counts[i]) {
+      rows[i] = (unsigned char)row_count; /* < 256, since i is missing */
+    }
+  }
+  return row_count + 1;
+}
+
+size_t get_alphabet_size(char const * const pointer,
+                         size_t const size) {
+  unsigned char seen[256] = {0};
+  size_t alphabet_size = 0;
+  size_t i = 0;
+
+  for (i = 0; i < size; ++i) {
+    unsigned char const unsigned_char = *(unsigned char const *)(pointer + i);
+    alphabet_size += !seen[unsigned_char];
+    seen[unsigned_char] = 1;
+  }
+  return alphabet_size;
+}
+
+void match_masks_destroy(match_masks * const masks) {
+  if (masks) {
+    free(masks->storage);
+  }
+  free(masks);
+}
+
+/*  match_masks_create allocates match masks for patterns of up to capacity
+    bytes, with up to alphabet_size distinct byte values; match_masks_fill
+    makes them represent a pattern.
+*/
+
+int match_masks_create(size_t const capacity,
+                       size_t const alphabet_size,
+                       match_masks ** const masks) {
+  match_masks * masks_ = NULL;
+  size_t size = 0;
+  int ret = 0;
+
+  masks_ = stats_calloc( 1, sizeof(*masks_) );
+  if (!masks_) {
+    return 1;
+  }
+  masks_->stride = get_word_count(capacity);
+  masks_->row_capacity = (alphabet_size < 256 ? alphabet_size : 256) + 1;
+  ret = size_t_mul(&size, masks_->stride, masks_->row_capacity);
+  if (ret) {
+    free(masks_);
+    return ret;
+  }
+  masks_->storage = stats_calloc( size + 1, sizeof(*masks_->storage) );
+  if (!masks_->storage) {
+    free(masks_);
+    return 1;
+  }
+  masks_->words = masks_->storage;
+
+  *masks = masks_;
+  return 0;
+}
+
+void match_masks_fill(match_masks * const masks,
+                      char const * const pointer,
+                      size_t const size) {
+  size_t counts[256] = {0};
+  size_t i = 0;
+
+  assert( masks->storage && get_word_count(size) <= masks->stride );
+  for (i = 0; i < size; ++i) {
+    ++counts[*(unsigned char const *)(pointer + i)];
+  }
+  masks->row_count = set_rows(counts, masks->rows);
+  assert(masks->row_count <= masks->row_capacity);
+  memset( masks->storage, 0,
+          masks->row_count * masks->stride * sizeof(*masks->storage) );
+  for (i = 0; i < size; ++i) {
+    unsigned char const row = masks->rows[*(unsigned char const *)(pointer + i)];
+    masks->storage[row * masks->stride + i / 64] |= (uint64_t)1 << (i % 64);
+  }
+  masks->size = size;
+}
+
+/*  bit_parallel_step advances one word of a column by one text byte, whose
+    match mask for the word is eq. The horizontal differences that enter the
+    word at its top (*hp, *hn) are replaced by those that leave it at the
+    given bit.
+*/
+
+void bit_parallel_step(uint64_t * const vp,
+                       uint64_t * const vn,
+                       uint64_t eq,
+                       uint64_t * const hp_carry,
+                       uint64_t * const hn_carry,
+                       unsigned int const shift) {
+  uint64_t const xv = eq | *vn;
+  uint64_t xh = 0;
+  uint64_t hp = 0;
+  uint64_t hn = 0;
+  uint64_t hp_out = 0;
+  uint64_t hn_out = 0;
+
+  eq |= *hn_carry;
+  xh = (((eq & *vp) + *vp) ^ *vp) | eq;
+  hp = *vn | ~(xh | *vp);
+  hn = *vp & xh;
+  hp_out = (hp >> shift) & 1;
+  hn_out = (hn >> shift) & 1;
+  hp = (hp << 1) | *hp_carry;
+  hn = (hn << 1) | *hn_carry;
+  *hp_carry = hp_out;
+  *hn_carry = hn_out;
+  *vp = hn | ~(xv | hp);
+  *vn = hp & xv;
+}
+
+/*  get_levenshtein_distance_masked computes the distance between the pattern
+    of size pattern_size, given by its match masks, and the text.
+*/
+
+int get_levenshtein_distance_masked(uint64_t const * const words,
+                                    size_t const stride,
+                                    unsigned char const rows[256],
+                                    size_t const pattern_size,
+                                    char const * const text,
+                                    size_t const text_size,
+                                    size_t * const distance) {
+  size_t const word_count = get_word_count(pattern_size);
+  uint64_t * vp = NULL; /* positive vertical differences */
+  uint64_t * vn = NULL; /* negative vertical differences */
+  uint64_t const * eqs = NULL;
+  uint64_t hp_in = 0;
+  uint64_t hn_in = 0;
+  unsigned int shift = 63;
+  size_t score = pattern_size;
+  size_t i = 0;
+  size_t w = 0;
+
+  if (!pattern_size) {
+    *distance = text_size;
+    return 0;
+  }
+  vp = stats_calloc( 2 * word_count, sizeof(*vp) );
+  if (!vp) {
+    return 1;
+  }
+  vn = vp + word_count;
+  for (w = 0; w < word_count; ++w) {
+    vp[w] = ~(uint64_t)0;
+  }
+
+  for (i = 0; i < text_size; ++i) {
+    eqs = words + rows[*(unsigned char const *)(text + i)] * stride;
+    hp_in = 1; /* The first row grows by one per column. */
+    hn_in = 0;
+    for (w = 0; w < word_count; ++w) {
+      if (w + 1 == word_count) {
+        shift = (unsigned int)( (pattern_size - 1) % 64 );
+      }
+      bit_parallel_step(&vp[w], &vn[w], eqs[w], &hp_in, &hn_in, shift);
+    }
+    shift = 63;
+    score += hp_in;
+    score -= hn_in;
+  }
+
+  free(vp);
+  *distance = score;
+  return 0;
+}
+
+/*  get_indel_distance_masked computes the indel distance (insertions and
+    deletions only) between the pattern and the text: size_1 + size_2 minus
+    twice the length of a longest common subsequence (LCS). The LCS length is
+    computed with the bit-vector algorithm of Hyyrö ("Bit-parallel LCS-length
+    computation revisited", 2004); per word and text byte, it takes an AND, an
+    addition with carry and an OR. The zero bits of v mark the rows at which the
+    LCS length grows.
+*/
+
+int uint64_popcount(uint64_t op) {
+  int count = 0;
+
+  while (op) {
+    op &= op - 1;
+    ++count;
+  }
+  return count;
+}
+
+int get_indel_distance_masked(uint64_t const * const words,
+                              size_t const stride,
+                              unsigned char const rows[256],
+                              size_t const pattern_size,
+                              char const * const text,
+                              size_t const text_size,
+                              size_t * const distance) {
+  size_t const word_count = get_word_count(pattern_size);
+  uint64_t * v = NULL;
+  uint64_t const * eqs = NULL;
+  uint64_t u = 0;
+  uint64_t sum = 0;
+  uint64_t carry = 0;
+  size_t lcs = 0;
+  size_t i = 0;
+  size_t w = 0;
+
+  if (!pattern_size) {
+    *distance = text_size;
+    return 0;
+  }
+  v = stats_calloc( word_count, sizeof(*v) );
+  if (!v) {
+    return 1;
+  }
+  for (w = 0; w < word_count; ++w) {
+    v[w] = ~(uint64_t)0;
+  }
+
+  for (i = 0; i < text_size; ++i) {
+    eqs = words + rows[*(unsigned char const *)(text + i)] * stride;
+    carry = 0;
+    for (w = 0; w < word_count; ++w) {
+      u = v[w] & eqs[w];
+      sum = v[w] + carry;
+      carry = sum < carry;
+      sum += u;
+      carry |= sum < u;
+      v[w] = sum | (v[w] & ~eqs[w]);
+    }
+  }
+
+  for (w = 0; w < word_count; ++w) {
+    u = ~v[w];
+    if (w + 1 == word_count && pattern_size % 64) {
+      u &= ((uint64_t)1 << (pattern_size % 64)) - 1;
+    }
+    lcs += uint64_popcount(u);
+  }
+  free(v);
+  *distance = pattern_size + text_size - 2 * lcs;
+  return 0;
+}
+
+/*  get_osa_distance_masked computes the optimal string alignment distance
+    (Levenshtein with transpositions of adjacent bytes, where no byte is edited
+    twice) between the pattern and the text. It extends the recurrence of
+    bit_parallel_step with the transposition term of Hyyrö ("A bit-vector
+    algorithm for computing Levenshtein and Damerau edit distances", 2003),
+    which needs the diagonal differences (d0) and the match masks of the
+    previous text byte.
+*/
+
+int get_osa_distance_masked(uint64_t const * const words,
+                            size_t const stride,
+                            unsigned char const rows[256],
+                            size_t const pattern_size,
+                            char const * const text,
+                            size_t const text_size,
+                            size_t * const distance) {
+  size_t const word_count = get_word_count(pattern_size);
+  uint64_t * vp = NULL; /* positive vertical differences */
+  uint64_t * vn = NULL; /* negative vertical differences */
+  uint64_t * d0 = NULL; /* zero diagonal differences */
+  uint64_t * pm = NULL; /* match masks of the previous text byte */
+  uint64_t const * eqs = NULL;
+  uint64_t eq = 0;
+  uint64_t x = 0;
+  uint64_t tr = 0;
+  uint64_t tr_in = 0;
+  uint64_t d = 0;
+  uint64_t hp = 0;
+  uint64_t hn = 0;
+  uint64_t hp_in = 0;
+  uint64_t hn_in = 0;
+  uint64_t hp_out = 0;
+  uint64_t hn_out = 0;
+  unsigned int shift = 63;
+  size_t score = pattern_size;
+  size_t i = 0;
+  size_t w = 0;
+
+  if (!pattern_size) {
+    *distance = text_size;
+    return 0;
+  }
+  vp = stats_calloc( 4 * word_count, sizeof(*vp) );
+  if (!vp) {
+    return 1;
+  }
+  vn = vp + word_count;
+  d0 = vn + word_count;
+  pm = d0 + word_count;
+  for (w = 0; w < word_count; ++w) {
+    vp[w] = ~(uint64_t)0;
+  }
+
+  for (i = 0; i < text_size; ++i) {
+    eqs = words + rows[*(unsigned char const *)(text + i)] * stride;
+    hp_in = 1; /* The first row grows by one per column. */
+    hn_in = 0;
+    tr_in = 0;
+    for (w = 0; w < word_count; ++w) {
+      if (w + 1 == word_count) {
+        shift = (unsigned int)( (pattern_size - 1) % 64 );
+      }
+      eq = eqs[w];
+      tr = ~d0[w] & eq;
+      x = (tr << 1 | tr_in) & pm[w];
+      tr_in = tr >> 63;
+      tr = x;
+      x = eq | hn_in;
+      d = (((x & vp[w]) + vp[w]) ^ vp[w]) | x | vn[w] | tr;
+      hp = vn[w] | ~(d | vp[w]);
+      hn = vp[w] & d;
+      hp_out = (hp >> shift) & 1;
+      hn_out = (hn >> shift) & 1;
+      hp = (hp << 1) | hp_in;
+      hn = (hn << 1) | hn_in;
+      hp_in = hp_out;
+      hn_in = hn_out;
+      vp[w] = hn | ~(d | hp);
+      vn[w] = hp & d;
+      d0[w] = d;
+      pm[w] = eq;
+    }
+    shift = 63;
+    score += hp_in;
+    score -= hn_in;
+  }
+
+  free(vp);
+  *distance = score;
+  return 0;
+}
+
+/*  The metric selects the distance: 'l' (Levenshtein), 'i' (indel) or 'o'
+    (optimal string alignment).
+*/
+
+int get_distance_masked(char const metric,
+                        uint64_t const * const words,
+                        size_t const stride,
+                        unsigned char const rows[256],
+                        size_t const pattern_size,
+                        char const * const text,
+                        size_t const text_size,
+                        size_t * const distance) {
+  switch (metric) {
+  case 'l':
+    return get_levenshtein_distance_masked(words, stride, rows, pattern_size,
+                                           text, text_size, distance);
+  case 'i':
+    return get_indel_distance_masked(words, stride, rows, pattern_size,
+                                     text, text_size, distance);
+  case 'o':
+    return get_osa_distance_masked(words, stride, rows, pattern_size,
+                                   text, text_size, distance);
+  }
+  return 1;
+}
+
+int get_distance_bit_parallel(char const metric,
+                              buffer const * const buffer_1,
+                              buffer const * const buffer_2,
+                              size_t * const distance) {
+  buffer const * buf_small = buffer_1;
+  buffer const * buf_large = buffer_2;
+  match_masks * masks = NULL;
+  int ret = 0;
+  STATS_TIMER(timer)
+
+  if (buffer_2->size < buffer_1->size) {
+    buf_small = buffer_2;
+    buf_large = buffer_1;
+  }
+  STATS_START(timer);
+  ret = match_masks_create(buf_small->size,
+                           get_alphabet_size(buf_small->pointer, buf_small->size),
+                           &masks);
+  if (ret) {
+    return ret;
+  }
+  match_masks_fill(masks, buf_small->pointer, buf_small->size);
+  ret = get_distance_masked(metric, masks->words, masks->stride, masks->rows,
+                            masks->size,
+                            buf_large->pointer, buf_large->size,
+                            distance);
+  match_masks_destroy(masks);
+  if (!ret) {
+    STATS_STOP(timer, STATS_DP);
+    STATS_COUNT(STATS_CELLS, (double)buf_small->size * buf_large->size);
+  }
+  return ret;
+}
+
+int get_levenshtein_distance_bit_parallel(buffer const * const buffer_1,
+                                          buffer const * const buffer_2,
+                                          size_t * const distance) {
+  return get_distance_bit_parallel('l', buffer_1, buffer_2, distance);
+}
+
+
+
+/*  Computing the Levenshtein distances of short bytestrings in lanes
+
+    A pattern of up to LANE_PATTERN_SIZE bytes fits into a single word of the
+    bit-parallel algorithm. A lane group compares up to LANE_COUNT such
+    patterns, each with its own text, at once: lane l holds the state of the
+    l-th comparison, and each step applies the same word operations to all
+    lanes. The loops over the lanes have a fixed trip count and no branches:
+    a lane whose text has ended, or that is unused, reads the first byte of its
+    text (or of an empty string) and keeps its state. The 8 lanes fill two
+    AVX2 registers or one AVX-512 register.
+
+    Whether the loops run on vector registers depends on the compiler and its
+    flags; at -O2, GCC leaves them scalar. Therefore, with GCC on x86-64 Linux,
+    VECTOR_KERNEL compiles a kernel at -O3 for AVX-512, AVX2 and the baseline,
+    and the dynamic loader picks the clone that the processor supports.
+    Elsewhere, or with NO_VECTOR_CLONES, the kernel is compiled as usual; so
+    it is with ThreadSanitizer, whose runtime is not ready yet when the loader
+    runs the resolvers of the clones.
+*/
+
+#if defined(__GNUC__) && !defined(__clang__) && \
+    defined(__x86_64__) && defined(__linux__) && \
+    !defined(__SANITIZE_THREAD__) && !defined(NO_VECTOR_CLONES)
+#  define VECTOR_KERNEL \
+     __attribute__(( target_clones("avx512f", "avx2", "default"), optimize("O3") ))
+#else
+#  define VECTOR_KERNEL
+#endif
+
+#define LANE_COUNT 8
+#define LANE_PATTERN_SIZE 64
+
+typedef struct {
+  char const * pointer;
+  size_t size;
+} record;
+
+typedef struct {
+  uint64_t masks[LANE_COUNT][256];
+  record patterns[LANE_COUNT];
+  record texts[LANE_COUNT];
+  size_t count;
+} lane_group;
+
+void lane_group_destroy(lane_group * const group) {
+  free(group);
+}
+
+int lane_group_create(lane_group ** const group) {
+  lane_group * group_ = NULL;
+
+  group_ = stats_calloc( 1, sizeof(*group_) );
+  if (!group_) {
+    return 1;
+  }
+
+  *group = group_;
+  return 0;
+}
+
+/*  lane_group_add assigns the next lane to the comparison of the pattern with
+    the text. Both must stay in memory until lane_group_run returns.
+*/
+
+void lane_group_add(lane_group * const group,
+                    char const * const pattern,
+                    size_t const pattern_size,
+                    char const * const text,
+                    size_t const text_size) {
+  size_t const l = group->count;
+  size_t i = 0;
+
+  assert(l < LANE_COUNT && pattern_size <= LANE_PATTERN_SIZE);
+  for (i = 0; i < pattern_size; ++i) {
+    unsigned char const unsigned_char = *(unsigned char const *)(pattern + i);
+    group->masks[l][unsigned_char] |= (uint64_t)1 << i;
+  }
+  group->patterns[l].pointer = pattern;
+  group->patterns[l].size = pattern_size;
+  group->texts[l].pointer = text;
+  group->texts[l].size = text_size;
+  ++group->count;
+}
+
+/*  lane_group_run stores the distance of the l-th comparison in distances[l]
+    and empties the group.
+*/
+
+VECTOR_KERNEL
+void lane_group_run(lane_group * const group,
+                    size_t * const distances) {
+  static char const empty[1] = {0};
+  char const * pointers[LANE_COUNT];
+  uint64_t sizes[LANE_COUNT];
+  uint64_t vp[LANE_COUNT];
+  uint64_t vn[LANE_COUNT];
+  uint64_t eq[LANE_COUNT];
+  uint64_t last[LANE_COUNT]; /* the bit of the last row */
+  uint64_t active[LANE_COUNT];
+  uint64_t score[LANE_COUNT];
+  uint64_t xv = 0;
+  uint64_t xh = 0;
+  uint64_t hp = 0;
+  uint64_t hn = 0;
+  size_t text_size = 0;
+  size_t i = 0;
+  size_t l = 0;
+  STATS_TIMER(timer)
+
+  STATS_START(timer);
+  for (l = 0; l < LANE_COUNT; ++l) {
+    vp[l] = ~(uint64_t)0;
+    vn[l] = 0;
+    last[l] = 0;
+    score[l] = 0;
+    pointers[l] = empty;
+    sizes[l] = 0;
+    if (l < group->count) {
+      if (group->texts[l].size) {
+        pointers[l] = group->texts[l].pointer;
+        sizes[l] = group->texts[l].size;
+      }
+      if (group->patterns[l].size) {
+        last[l] = (uint64_t)1 << (group->patterns[l].size - 1);
+      }
+      score[l] = group->patterns[l].size;
+      if (text_size < group->texts[l].size) {
+        text_size = group->texts[l].size;
+      }
+    }
+  }
+
+  for (i = 0; i < text_size; ++i) {
+    for (l = 0; l < LANE_COUNT; ++l) {
+      active[l] = (uint64_t)0 - (uint64_t)(i < sizes[l]);
+      eq[l] = active[l] &
+              group->masks[l][*(unsigned char const *)(pointers[l] + (i & active[l]))];
+    }
+    for (l = 0; l < LANE_COUNT; ++l) {
+      xv = eq[l] | vn[l];
+      xh = (((eq[l] & vp[l]) + vp[l]) ^ vp[l]) | eq[l];
+      hp = vn[l] | ~(xh | vp[l]);
+      hn = vp[l] & xh;
+      score[l] += active[l] & ( (uint64_t)((hp & last[l]) != 0) -
+                                (uint64_t)((hn & last[l]) != 0) );
+      hp = (hp << 1) | 1;
+      hn <<= 1;
+      vp[l] ^= active[l] & ( vp[l] ^ (hn | ~(xv | hp)) );
+      vn[l] ^= active[l] & ( vn[l] ^ (hp & xv) );
+    }
+  }
+
+  for (l = 0; l < group->count; ++l) {
+    /* An empty pattern has no last row; its distance is the text size. */
+    distances[l] = group->patterns[l].size ? (size_t)score[l] : group->texts[l].size;
+    for (i = 0; i < group->patterns[l].size; ++i) {
+      group->masks[l][*(unsigned char const *)(group->patterns[l].pointer + i)] = 0;
+    }
+    STATS_COUNT(STATS_CELLS, (double)group->patterns[l].size * group->texts[l].size);
+  }
+  group->count = 0;
+  STATS_STOP(timer, STATS_DP);
+}
+
+
+/* Computing a lower bound on the Levenshtein distance */
+
+size_t distance(size_t const size_1,
+                size_t const size_2) {
+  if (size_1 < size_2) {
+    return size_2 - size_1;
+  }
+  return size_1 - size_2;
+}
+
+void get_histogram(buffer const * const buffer_,
+                   size_t freq[256]) {
+  size_t i = 0;
+
+  memset( freq, 0, 256 * sizeof(*freq) );
+  for (i = 0; i < buffer_->size; ++i) {
+    unsigned char const unsigned_char = *(unsigned char const *)(buffer_->pointer + i);
+    ++freq[unsigned_char];
+  }
+}
+
+/*  get_ld_lb_from_histograms computes the bound of get_ld_lb from the byte
+    histograms and the sizes of both bytestrings.
+*/
+
+int get_ld_lb_from_histograms(size_t const freq_buf_1[256],
+                              size_t const size_1,
+                              size_t const freq_buf_2[256],
+                              size_t const size_2,
+                              size_t * const bound) { /* lower bound */
+  size_t bound_ = 0;
+  int ret = 0;
+  size_t i = 0;
+  size_t t_1 = 0;
+  size_t t_2 = 0;
+
+  for (i = 0; i < 256; ++i) {
+    t_1 = distance( freq_buf_1[i],
+                    freq_buf_2[i] );
+    if (bound_ < t_1) {
+        bound_ = t_1;
+    }
+  }
+
+  t_1 = 0;
+  for (i = 0; i < 256; ++i) {
+    t_2 = distance( freq_buf_1[i],
+                    freq_buf_2[i] );
+    ret = size_t_add_aug(&t_1, t_2);
+    if (ret) {
+      return ret;
+    }
+  }
+  t_2 = distance(size_1,
+                 size_2);
+  ret = size_t_add_aug(&t_1, t_2);
+  if (ret) {
+    return ret;
+  }
+  if (t_1) {
+    t_1 = 1 + (t_1 - 1) / 2;
+  }
+  if (bound_ < t_1) {
+      bound_ = t_1;
+  }
+
+  *bound = bound_;
+  return 0;
+}
+
+/*  A sketch counts the 2-grams (pairs of adjacent bytes) of a bytestring,
+    hashed into SKETCH_BINS bins. A substitution replaces up to two 2-grams,
+    which changes the counts by up to 4 in total; an insertion or a deletion
+    changes them by up to 3, and the size by 1. Hashing can only shrink the
+    differences of the counts. Thus, a quarter of the sum of both is another
+    lower bound. A transposition of adjacent bytes replaces up to three
+    2-grams, so the optimal string alignment distance takes a sixth.
+*/
+
+#define SKETCH_BINS 4096
+
+void get_sketch(buffer const * const buffer_,
+                size_t sketch[SKETCH_BINS]) {
+  uint32_t gram = 0;
+  size_t i = 0;
+
+  memset( sketch, 0, SKETCH_BINS * sizeof(*sketch) );
+  for (i = 0; i < buffer_->size; ++i) {
+    gram = (gram << 8 | *(unsigned char const *)(buffer_->pointer + i)) & 0xffff;
+    if (i) {
+      ++sketch[(uint32_t)(gram * UINT32_C(0x9e3779b1)) >> 20];
+    }
+  }
+}
+
+int get_ld_lb_from_sketches(char const metric,
+                            size_t const sketch_1[SKETCH_BINS],
+                            size_t const size_1,
+                            size_t const sketch_2[SKETCH_BINS],
+                            size_t const size_2,
+                            size_t * const bound) { /* lower bound */
+  size_t const changes = metric == 'o' ? 6 : 4;
+  size_t t = 0;
+  size_t i = 0;
+  int ret = 0;
+
+  for (i = 0; i < SKETCH_BINS; ++i) {
+    ret = size_t_add_aug( &t, distance(sketch_1[i], sketch_2[i]) );
+    if (ret) {
+      return ret;
+    }
+  }
+  ret = size_t_add_aug( &t, distance(size_1, size_2) );
+  if (ret) {
+    return ret;
+  }
+  *bound = t / changes + (t % changes != 0);
+  return 0;
+}
+
+/*  get_ld_lb bounds the Levenshtein distance (metric 'l') or the optimal
+    string alignment distance ('o'). A transposition leaves the histogram as it
+    is, so the histogram bound holds for both.
+*/
+
+int get_ld_lb(char const metric,
+              buffer const * const buffer_1,
+              buffer const * const buffer_2,
+              size_t * const bound) { /* lower bound */
+  size_t freq_buf_1[256] = {0};
+  size_t freq_buf_2[256] = {0};
+  size_t sketch_1[SKETCH_BINS] = {0};
+  size_t sketch_2[SKETCH_BINS] = {0};
+  size_t bound_ = 0;
+  size_t t = 0;
+  int ret = 0;
+  STATS_TIMER(timer)
+
+  STATS_START(timer);
+  get_histogram(buffer_1, freq_buf_1);
+  get_histogram(buffer_2, freq_buf_2);
+  ret = get_ld_lb_from_histograms(freq_buf_1, buffer_1->size,
+                                  freq_buf_2, buffer_2->size,
+                                  &bound_);
+  if (ret) {
+    return ret;
+  }
+  get_sketch(buffer_1, sketch_1);
+  get_sketch(buffer_2, sketch_2);
+  ret = get_ld_lb_from_sketches(metric, sketch_1, buffer_1->size,
+                                sketch_2, buffer_2->size,
+                                &t);
+  if (ret) {
+    return ret;
+  }
+  if (bound_ < t) {
+    bound_ = t;
+  }
+
+  STATS_STOP(timer, STATS_HISTOGRAM);
+  *bound = bound_;
+  return 0;
+}
+
+
+/*  For the indel distance, each operation changes the count of one byte by
+    one; thus, the sum of the differences of the counts is a lower bound.
+*/
+
+int get_indel_lb_from_histograms(size_t const freq_buf_1[256],
+                                 size_t const freq_buf_2[256],
+                                 size_t * const bound) { /* lower bound */
+  size_t bound_ = 0;
+  size_t i = 0;
+  int ret = 0;
+
+  for (i = 0; i < 256; ++i) {
+    ret = size_t_add_aug( &bound_, distance(freq_buf_1[i], freq_buf_2[i]) );
+    if (ret) {
+      return ret;
+    }
+  }
+
+  *bound = bound_;
+  return 0;
+}
+
+int get_indel_lb(buffer const * const buffer_1,
+                 buffer const * const buffer_2,
+                 size_t * const bound) { /* lower bound */
+  size_t freq_buf_1[256] = {0};
+  size_t freq_buf_2[256] = {0};
+
+  get_histogram(buffer_1, freq_buf_1);
+  get_histogram(buffer_2, freq_buf_2);
+  return get_indel_lb_from_histograms(freq_buf_1, freq_buf_2, bound);
+}
+
+
+/* Computing an upper bound on the Levenshtein distance */
+
+size_t minimum(size_t const size_1,
+               size_t const size_2) {
+  if (size_1 < size_2) {
+    return size_1;
+  }
+  return size_2;
+}
+
+size_t maximum(size_t const size_1,
+               size_t const size_2) {
+  if (size_1 < size_2) {
+    return size_2;
+  }
+  return size_1;
+}
+
+/*  get_ub_masked computes the bound of get_ld_ub, for the distance of the
+    metric (see get_distance_masked). If masks_1 is not NULL, it holds the match
+    masks of buffer_1; each chunk of buffer_1 starts at a multiple of 64 bytes,
+    so its masks are a slice of them.
+*/
+
+int get_ub_masked(char const metric,
+                  buffer const * const buffer_1,
+                  match_masks const * const masks_1,
+                  buffer const * const buffer_2,
+                  size_t * const bound) { /* upper bound */
+  size_t bound_ = 0;
+  int ret = 0;
+  size_t buf_1_t = 0;
+  size_t buf_2_t = 0;
+  buffer sub_buf_1 = {0};
+  buffer sub_buf_2 = {0};
+  size_t distance = 0;
+  match_masks * sub_masks = NULL;
+  uint64_t const * words = NULL;
+  size_t stride = 0;
+  unsigned char const * rows = NULL;
+  STATS_TIMER(timer)
+  STATS_TIMER(chunk_timer)
+
+  STATS_START(timer);
+  if (!masks_1) {
+    ret = match_masks_create(1024, 256, &sub_masks);
+    if (ret) {
+      return ret;
+    }
+  }
+  
+  buf_1_t = buffer_1->size;
+  buf_2_t = buffer_2->size;
+  sub_buf_1.pointer = buffer_1->pointer;
+  sub_buf_2.pointer = buffer_2->pointer;
+  sub_buf_1.size = minimum(buf_1_t, 1024);
+  sub_buf_2.size = minimum(buf_2_t, 1024);
+
+  while (sub_buf_1.size ||
+         sub_buf_2.size) {
+    if (masks_1) {
+      words = masks_1->words + (size_t)(sub_buf_1.pointer - buffer_1->pointer) / 64;
+      stride = masks_1->stride;
+      rows = masks_1->rows;
+    }
+    else {
+      match_masks_fill(sub_masks, sub_buf_1.pointer, sub_buf_1.size);
+      words = sub_masks->words;
+      stride = sub_masks->stride;
+      rows = sub_masks->rows;
+    }
+    STATS_START(chunk_timer);
+    ret = get_distance_masked(metric, words, stride, rows, sub_buf_1.size,
+                              sub_buf_2.pointer, sub_buf_2.size,
+                              &distance);
+    if (ret) {
+      match_masks_destroy(sub_masks);
+      return ret;
+    }
+    STATS_STOP(chunk_timer, STATS_DP);
+    STATS_COUNT(STATS_CELLS, (double)sub_buf_1.size * sub_buf_2.size);
+    bound_ += distance;
+    
+    buf_1_t -= sub_buf_1.size;
+    buf_2_t -= sub_buf_2.size;
+    sub_buf_1.pointer += sub_buf_1.size;
+    sub_buf_2.pointer += sub_buf_2.size;
+    sub_buf_1.size = minimum(buf_1_t, sub_buf_1.size);
+    sub_buf_2.size = minimum(buf_2_t, sub_buf_2.size);
+  }
+
+  match_masks_destroy(sub_masks);
+  STATS_STOP(timer, STATS_CHUNKS);
+  *bound = bound_;
+  return 0;
+}
+
+int get_ld_ub(buffer const * const buffer_1,
+              buffer const * const buffer_2,
+              size_t * const bound) { /* upper bound */
+  return get_ub_masked('l', buffer_1, NULL, buffer_2, bound);
+}
+
+
+
+/*  Computing the Levenshtein distances between one and many bytestrings
+
+    get_levenshtein_distances computes the distance between a probe and each
+    bytestring of a collection. The rows of the dynamic programming for a
+    prefix of a bytestring only depend on that prefix; thus, bytestrings that
+    share a prefix share its rows. The collection is sorted, so that the
+    bytestrings form the leaves of a trie in depth-first order, and the longest
+    common prefix (lcp) of neighbours is the depth of their branching node.
+    While a bytestring is processed, the rows at the depths of the branching
+    nodes that later bytestrings start from are kept on a stack. The stack
+    holds a row per distinct depth, which is often far less than a row per
+    bytestring; so, its rows are grown as it grows.
+
+    If a threshold is given, each distance beyond the threshold is reported as
+    SIZE_MAX. Since row minima never decrease with depth, a subtree whose row
+    minimum exceeds the threshold is skipped as a whole.
+    Bytestrings of up to LANE_PATTERN_SIZE bytes do not take part in the trie;
+    they are compared with the probe in lane groups instead.
+*/
+
+typedef struct {
+  buffer const * buffer_;
+  size_t index;
+} buffer_order;
+
+int buffer_order_compare(void const * const op1,
+                         void const * const op2) {
+  buffer const * const buffer_1 = ((buffer_order const *)op1)->buffer_;
+  buffer const * const buffer_2 = ((buffer_order const *)op2)->buffer_;
+  size_t const size = minimum(buffer_1->size, buffer_2->size);
+  int order = 0;
+
+  if (size) {
+    order = memcmp(buffer_1->pointer, buffer_2->pointer, size);
+  }
+  if (order) {
+    return order;
+  }
+  if (buffer_1->size != buffer_2->size) {
+    return buffer_1->size < buffer_2->size ? -1 : 1;
+  }
+  return 0;
+}
+
+size_t get_common_prefix_size(buffer const * const buffer_1,
+                              buffer const * const buffer_2) {
+  size_t const size = minimum(buffer_1->size, buffer_2->size);
+  size_t i = 0;
+
+  while (i < size && buffer_1->pointer[i] == buffer_2->pointer[i]) {
+    ++i;
+  }
+  return i;
+}
+
+int get_levenshtein_distances(buffer const * const probe,
+                              buffer * const * const buffers,
+                              size_t const count,
+                              size_t const threshold,
+                              size_t * const distances) {
+  buffer_order * order = NULL;
+  size_t * lcps = NULL;    /* lcps[k]: lcp of the bytestrings k and k + 1 */
+  size_t * depths = NULL;  /* the depths of the rows on the stack */
+  size_t * pushes = NULL;  /* the depths to push, in descending order */
+  size_t * rows = NULL;    /* the rows on the stack */
+  size_t * work = NULL;    /* the two working rows */
+  size_t * more_rows = NULL;
+  size_t row_size = 0;
+  size_t stack_size = 0;
+  size_t stack_capacity = 0;
+  size_t push_count = 0;
+  size_t k = 0;
+  size_t d = 0;
+  size_t t = 0;
+  size_t start = 0;
+  size_t pruned = 0;
+  size_t * row_1 = NULL;
+  size_t * row_2 = NULL;
+  size_t * row_t = NULL;
+  buffer const * buf = NULL;
+  lane_group * group = NULL;
+  size_t lane_indices[LANE_COUNT];
+  size_t lane_distances[LANE_COUNT];
+  size_t n = 0;
+  double cells = 0;
+  STATS_TIMER(timer)
+
+  if (!count) {
+    return 0;
+  }
+  if ( lane_group_create(&group) ) {
+    return 1;
+  }
+  for (k = 0; k <= count; ++k) {
+    if ( group->count == LANE_COUNT ||
+         k == count && group->count ) {
+      n = group->count;
+      lane_group_run(group, lane_distances);
+      for (t = 0; t < n; ++t) {
+        distances[lane_indices[t]] = lane_distances[t] > threshold ? SIZE_MAX : lane_distances[t];
+      }
+    }
+    if (k < count && buffers[k]->size <= LANE_PATTERN_SIZE) {
+      lane_indices[group->count] = k;
+      lane_group_add(group, buffers[k]->pointer, buffers[k]->size,
+                     probe->pointer, probe->size);
+    }
+  }
+  lane_group_destroy(group);
+
+  stack_capacity = minimum(count + 1, 16);
+  if ( size_t_add(&row_size, probe->size, 1) ||
+       size_t_mul(&t, row_size, stack_capacity) ) {
+    return 1;
+  }
+  order = stats_calloc( count, sizeof(*order) );
+  lcps = stats_calloc( count, sizeof(*lcps) );
+  depths = stats_calloc( count + 1, sizeof(*depths) );
+  pushes = stats_calloc( count + 1, sizeof(*pushes) );
+  rows = stats_calloc( t, sizeof(*rows) );
+  work = stats_calloc( row_size, 2 * sizeof(*work) );
+  if (!order || !lcps || !depths || !pushes || !rows || !work) {
+    free(work);
+    free(rows);
+    free(pushes);
+    free(depths);
+    free(lcps);
+    free(order);
+    return 1;
+  }
+
+  for (k = 0, n = 0; k < count; ++k) {
+    if (buffers[k]->size > LANE_PATTERN_SIZE) {
+      order[n].buffer_ = buffers[k];
+      order[n].index = k;
+      ++n;
+    }
+  }
+  qsort( order, n, sizeof(*order), buffer_order_compare );
+  for (k = 0; k + 1 < n; ++k) {
+    lcps[k] = get_common_prefix_size(order[k].buffer_, order[k + 1].buffer_);
+  }
+
+  /* The stack starts with the row at depth 0. */
+  STATS_START(timer);
+  for (d = 0; d < row_size; ++d) {
+    rows[d] = d;
+  }
+  depths[0] = 0;
+  stack_size = 1;
+  row_1 = work;
+  row_2 = work + row_size;
+
+  for (k = 0; k < n; ++k) {
+    buf = order[k].buffer_;
+    start = k ? lcps[k - 1] : 0;
+    while (depths[stack_size - 1] > start) {
+      --stack_size;
+    }
+    assert(depths[stack_size - 1] == start);
+    memcpy( row_1, rows + (stack_size - 1) * row_size, row_size * sizeof(*row_1) );
+
+    /* The later bytestrings start from the prefix minima of the lcps. */
+    push_count = 0;
+    for (t = k, d = SIZE_MAX; t + 1 < n; ++t) {
+      d = minimum(d, lcps[t]);
+      if (d <= start) {
+        break;
+      }
+      if (!push_count || pushes[push_count - 1] != d) {
+        pushes[push_count++] = d;
+      }
+    }
+
+    pruned = 0;
+    for (d = start; d < buf->size; ++d) {
+      row_2[0] = d + 1;
+      levenshtein_row_step(row_1, row_2, probe, buf->pointer[d]);
+      row_t = row_1;
+      row_1 = row_2;
+      row_2 = row_t;
+
+      if (push_count && pushes[push_count - 1] == d + 1) {
+        if (stack_size == stack_capacity) {
+          more_rows = NULL;
+          if ( !size_t_mul(&t, row_size, 2 * stack_capacity) &&
+               !size_t_mul_aug( &t, sizeof(*rows) ) ) {
+            more_rows = stats_realloc(rows, t);
+          }
+          if (!more_rows) {
+            free(work);
+            free(rows);
+            free(pushes);
+            free(depths);
+            free(lcps);
+            free(order);
+            return 1;
+          }
+          rows = more_rows;
+          stack_capacity *= 2;
+        }
+        memcpy( rows + stack_size * row_size, row_1, row_size * sizeof(*row_1) );
+        depths[stack_size++] = d + 1;
+        --push_count;
+      }
+      if (threshold != SIZE_MAX) {
+        for (t = 0; t < row_size && row_1[t] > threshold; ++t) {
+        }
+        if (t == row_size) {
+          pruned = d + 1;
+          break;
+        }
+      }
+    }
+    cells += (double)( (pruned ? pruned : buf->size) - start ) * probe->size;
+
+    if (pruned) {
+      distances[order[k].index] = SIZE_MAX;
+      for (d = pruned; k + 1 < n; ++k) {
+        d = minimum(d, lcps[k]);
+        if (d < pruned) {
+          break;
+        }
+        distances[order[k + 1].index] = SIZE_MAX;
+      }
+      continue;
+    }
+    distances[order[k].index] = row_1[probe->size] > threshold ? SIZE_MAX : row_1[probe->size];
+  }
+  STATS_STOP(timer, STATS_DP);
+  STATS_COUNT(STATS_CELLS, cells);
+
+  free(work);
+  free(rows);
+  free(pushes);
+  free(depths);
+  free(lcps);
+  free(order);
+  return 0;
+}
+
+
+
+/*  Computing weighted edit distances
+
+    A cost table assigns a cost to the insertion and to the deletion of each
+    byte, and to the substitution of each byte by each other byte; a match
+    costs nothing. The weighted distance from the first bytestring to the
+    second is the least total cost of operations that turn the first into the
+    second; it is not symmetric unless the table is.
+*/
+
+#define COST_MAX 255
+
+typedef struct {
+  uint32_t insert[256];
+  uint32_t delete_[256];
+  uint32_t substitute[256 * 256]; /* [byte_1 * 256 + byte_2] */
+  uint32_t min_insert;
+  uint32_t min_delete;
+  uint32_t min_substitute;
+  uint32_t max_cost;
+  int unit; /* All costs are 1: the weighted distance is the Levenshtein one. */
+  uint64_t key; /* identifies the table in caches */
+} costs;
+
+void costs_destroy(costs * const costs_) {
+  free(costs_);
+}
+
+int costs_byte_from_string(unsigned char * const byte,
+                           char const * const string) {
+  char const * const digits = "0123456789abcdef";
+  char const * high = NULL;
+  char const * low = NULL;
+
+  if (string[0] && !string[1]) {
+    *byte = (unsigned char)string[0];
+    return 0;
+  }
+  if ( strlen(string) != 4 ||
+       string[0] != '0' ||
+       string[1] != 'x' ||
+       !string[2] || !(high = strchr(digits, string[2])) ||
+       !string[3] || !(low = strchr(digits, string[3])) ) {
+    return 1;
+  }
+  *byte = (unsigned char)( (high - digits) * 16 + (low - digits) );
+  return 0;
+}
+
+int costs_cost_from_string(uint32_t * const cost,
+                           char const * const string) {
+  size_t cost_ = 0;
+
+  if ( size_t_from_string(&cost_, string) ||
+       cost_ > COST_MAX ) {
+    return 1;
+  }
+  *cost = (uint32_t)cost_;
+  return 0;
+}
+
+/*  costs_apply applies the statement in the words of a line of a cost file
+    (see costs_create).
+*/
+
+int costs_apply(costs * const costs_,
+                char * const words[],
+                size_t const word_count) {
+  uint32_t cost = 0;
+  unsigned char byte_1 = 0;
+  unsigned char byte_2 = 0;
+  size_t i = 0;
+  size_t j = 0;
+
+  if ( word_count < 2 ||
+       costs_cost_from_string(&cost, words[word_count - 1]) ) {
+    return 1;
+  }
+  if ( !strcmp(words[0], "insert") ||
+       !strcmp(words[0], "delete") ) {
+    uint32_t * const table = words[0][0] == 'i' ? costs_->insert : costs_->delete_;
+
+    if (word_count == 2) {
+      for (i = 0; i < 256; ++i) {
+        table[i] = cost;
+      }
+      return 0;
+    }
+    if ( word_count != 3 ||
+         costs_byte_from_string(&byte_1, words[1]) ) {
+      return 1;
+    }
+    table[byte_1] = cost;
+    return 0;
+  }
+  if ( !strcmp(words[0], "substitute") ) {
+    if (word_count == 2) {
+      for (i = 0; i < 256 * 256; ++i) {
+        costs_->substitute[i] = cost;
+      }
+      return 0;
+    }
+    if ( word_count != 4 ||
+         costs_byte_from_string(&byte_1, words[1]) ||
+         costs_byte_from_string(&byte_2, words[2]) ) {
+      return 1;
+    }
+    costs_->substitute[byte_1 * 256 + byte_2] = cost;
+    return 0;
+  }
+  if ( !strcmp(words[0], "class") ) {
+    if (word_count != 3) {
+      return 1;
+    }
+    for (i = 0; words[1][i]; ++i) {
+      for (j = 0; words[1][j]; ++j) {
+        byte_1 = (unsigned char)words[1][i];
+        byte_2 = (unsigned char)words[1][j];
+        costs_->substitute[byte_1 * 256 + byte_2] = cost;
+      }
+    }
+    return 0;
+  }
+  if ( !strcmp(words[0], "case") ) {
+    if (word_count != 2) {
+      return 1;
+    }
+    for (i = 0; i < 26; ++i) {
+      costs_->substitute[('a' + i) * 256 + 'A' + i] = cost;
+      costs_->substitute[('A' + i) * 256 + 'a' + i] = cost;
+    }
+    return 0;
+  }
+  return 1;
+}
+
+/*  costs_finish clears the diagonal of the substitution table and derives the
+    minima, the maximum and the key.
+*/
+
+void costs_finish(costs * const costs_) {
+  uint64_t hash[2] = {0, 0};
+  uint64_t key = 0;
+  size_t i = 0;
+
+  for (i = 0; i < 256; ++i) {
+    costs_->substitute[i * 256 + i] = 0;
+  }
+  costs_->min_insert = COST_MAX;
+  costs_->min_delete = COST_MAX;
+  costs_->min_substitute = COST_MAX;
+  costs_->max_cost = 0;
+  costs_->unit = 1;
+  for (i = 0; i < 256; ++i) {
+    costs_->min_insert = minimum(costs_->min_insert, costs_->insert[i]);
+    costs_->min_delete = minimum(costs_->min_delete, costs_->delete_[i]);
+    costs_->max_cost = maximum(costs_->max_cost, costs_->insert[i]);
+    costs_->max_cost = maximum(costs_->max_cost, costs_->delete_[i]);
+    costs_->unit &= costs_->insert[i] == 1 && costs_->delete_[i] == 1;
+  }
+  for (i = 0; i < 256 * 256; ++i) {
+    if (i / 256 != i % 256) {
+      costs_->min_substitute = minimum(costs_->min_substitute, costs_->substitute[i]);
+      costs_->max_cost = maximum(costs_->max_cost, costs_->substitute[i]);
+      costs_->unit &= costs_->substitute[i] == 1;
+    }
+  }
+
+  hash_128((char const *)costs_->insert, sizeof(costs_->insert), hash);
+  key = uint64_fmix(hash[0] ^ hash[1]);
+  hash_128((char const *)costs_->delete_, sizeof(costs_->delete_), hash);
+  key = uint64_fmix(key ^ hash[0] ^ hash[1]);
+  hash_128((char const *)costs_->substitute, sizeof(costs_->substitute), hash);
+  key = uint64_fmix(key ^ hash[0] ^ hash[1]);
+  costs_->key = key;
+}
+
+/*  costs_create reads a cost file. Each line holds a statement; empty lines
+    and lines that start with # are ignored, and later statements override
+    earlier ones. Costs are integers from 0 to COST_MAX; unless set, they are 1.
+      insert [byte] cost        Set the cost of inserting (the byte).
+      delete [byte] cost        Set the cost of deleting (the byte).
+      substitute [byte byte] cost
+                                Set the cost of substituting (the first byte
+                                by the second).
+      class bytes cost          Set the cost of substituting any of the bytes
+                                by any other of them.
+      case cost                 Set the cost of substituting an ASCII letter by
+                                itself in the other case.
+    A byte is a single character or 0x followed by two lowercase hex digits.
+*/
+
+int costs_create(char const * const file_path,
+                 costs ** const costs_) {
+  costs * cost_table = NULL;
+  buffer * buf = NULL;
+  char * text = NULL;
+  char * line = NULL;
+  char * end = NULL;
+  char * words[5];
+  size_t word_count = 0;
+  size_t i = 0;
+  int ret = 0;
+
+  ret = buffer_create(file_path, SIZE_MAX, &buf);
+  if (ret) {
+    return ret;
+  }
+  cost_table = stats_calloc( 1, sizeof(*cost_table) );
+  text = stats_calloc(1, buf->size + 1);
+  if (!cost_table || !text) {
+    free(text);
+    costs_destroy(cost_table);
+    buffer_destroy(buf);
+    return 1;
+  }
+  memcpy(text, buf->pointer, buf->size);
+  buffer_destroy(buf);
+
+  for (i = 0; i < 256; ++i) {
+    cost_table->insert[i] = 1;
+    cost_table->delete_[i] = 1;
+  }
+  for (i = 0; i < 256 * 256; ++i) {
+    cost_table->substitute[i] = 1;
+  }
+
+  for (line = text; !ret && *line; line = end) {
+    end = strchr(line, '\n');
+    if (end) {
+      *end++ = '\0';
+    }
+    else {
+      end = line + strlen(line);
+    }
+    word_count = 0;
+    for (i = 0; line[i]; ) {
+      while (line[i] == ' ' || line[i] == '\t' || line[i] == '\r') {
+        line[i++] = '\0';
+      }
+      if (!line[i]) {
+        break;
+      }
+      if (word_count == 5) {
+        ret = 1;
+        break;
+      }
+      words[word_count++] = line + i;
+      while (line[i] && line[i] != ' ' && line[i] != '\t' && line[i] != '\r') {
+        ++i;
+      }
+    }
+    if (!ret && word_count && words[0][0] != '#') {
+      ret = costs_apply(cost_table, words, word_count);
+    }
+  }
+  free(text);
+  if (ret) {
+    costs_destroy(cost_table);
+    return ret;
+  }
+
+  costs_finish(cost_table);
+  *costs_ = cost_table;
+  return 0;
+}
+
+/*  get_weighted_distance fills the table of the distances between prefixes
+    along anti-diagonals: the cells with i + j = k only depend on the
+    diagonals k - 1 and k - 2, so each diagonal is one loop without carried
+    dependencies, which the compiler vectorizes. The second bytestring is
+    laid out in reverse, so that the loop reads all arrays in ascending order.
+    Distances are 32-bit; the bytestrings must be short enough for them.
+    The loop needs -O3 and a gather instruction to vectorize well, so it is a
+    VECTOR_KERNEL (see the lanes).
+*/
+
+VECTOR_KERNEL
+int get_weighted_distance(costs const * const costs_,
+                          buffer const * const buffer_1,
+                          buffer const * const buffer_2,
+                          size_t * const distance) {
+  unsigned char const * const bytes_1 = (unsigned char const *)buffer_1->pointer;
+  unsigned char const * const bytes_2 = (unsigned char const *)buffer_2->pointer;
+  size_t const n = buffer_1->size;
+  size_t const m = buffer_2->size;
+  uint32_t * memory = NULL;
+  uint32_t * diagonal_2 = NULL; /* diagonal k - 2, indexed by i */
+  uint32_t * diagonal_1 = NULL; /* diagonal k - 1 */
+  uint32_t * diagonal_0 = NULL; /* diagonal k */
+  uint32_t * deletes = NULL;    /* [i]: cost of deleting bytes_1[i - 1] */
+  uint32_t * rows = NULL;       /* [i]: row of bytes_1[i - 1] in the table */
+  uint32_t * inserts = NULL;    /* [m - j]: cost of inserting bytes_2[j - 1] */
+  uint32_t * columns = NULL;    /* [m - j]: bytes_2[j - 1] */
+  uint32_t * swap = NULL;
+  uint32_t insert_sum = 0;
+  uint32_t delete_sum = 0;
+  uint32_t value = 0;
+  uint32_t candidate = 0;
+  size_t words = 0;
+  size_t limit = 0;
+  size_t k = 0;
+  size_t low = 0;
+  size_t high = 0;
+  size_t t = 0;
+  int ret = 0;
+  STATS_TIMER(timer)
+
+  if (costs_->unit) {
+    return get_distance_bit_parallel('l', buffer_1, buffer_2, distance);
+  }
+  ret = size_t_add(&limit, n, m) ||
+        size_t_inc(&limit) ||
+        size_t_mul_aug(&limit, costs_->max_cost) ||
+        limit > UINT32_MAX;
+  ret = ret ||
+        size_t_add(&words, n, 1) ||
+        size_t_mul_aug(&words, 5) ||
+        size_t_add_aug(&words, m) ||
+        size_t_add_aug(&words, m);
+  if (ret) {
+    return 1;
+  }
+  memory = stats_calloc( words, sizeof(*memory) );
+  if (!memory) {
+    return 1;
+  }
+  STATS_START(timer);
+  diagonal_2 = memory;
+  diagonal_1 = diagonal_2 + (n + 1);
+  diagonal_0 = diagonal_1 + (n + 1);
+  deletes = diagonal_0 + (n + 1);
+  rows = deletes + (n + 1);
+  inserts = rows + (n + 1);
+  columns = inserts + m;
+  for (t = 1; t <= n; ++t) {
+    deletes[t] = costs_->delete_[bytes_1[t - 1]];
+    rows[t] = (uint32_t)bytes_1[t - 1] * 256;
+  }
+  for (t = 0; t < m; ++t) {
+    inserts[t] = costs_->insert[bytes_2[m - 1 - t]];
+    columns[t] = bytes_2[m - 1 - t];
+  }
+
+  for (k = 1; k <= n + m; ++k) {
+    low = k > m ? k - m : 1;
+    high = k - 1 < n ? k - 1 : n;
+    if (low <= high) {
+      uint32_t const * const left = diagonal_1 + (low - 1);
+      uint32_t const * const up = diagonal_1 + low;
+      uint32_t const * const diagonal = diagonal_2 + (low - 1);
+      uint32_t const * const delete_costs = deletes + low;
+      uint32_t const * const row = rows + low;
+      uint32_t const * const insert_costs = inserts + (low + m - k);
+      uint32_t const * const column = columns + (low + m - k);
+      uint32_t * const cell = diagonal_0 + low;
+
+      for (t = 0; t <= high - low; ++t) {
+        value = left[t] + delete_costs[t];
+        candidate = up[t] + insert_costs[t];
+        value = candidate < value ? candidate : value;
+        candidate = diagonal[t] + costs_->substitute[row[t] + column[t]];
+        value = candidate < value ? candidate : value;
+        cell[t] = value;
+      }
+    }
+    if (k <= m) {
+      insert_sum += costs_->insert[bytes_2[k - 1]];
+      diagonal_0[0] = insert_sum;
+    }
+    if (k <= n) {
+      delete_sum += costs_->delete_[bytes_1[k - 1]];
+      diagonal_0[k] = delete_sum;
+    }
+    swap = diagonal_2;
+    diagonal_2 = diagonal_1;
+    diagonal_1 = diagonal_0;
+    diagonal_0 = swap;
+  }
+
+  *distance = diagonal_1[n];
+  STATS_STOP(timer, STATS_DP);
+  STATS_COUNT(STATS_CELLS, (double)n * m);
+  free(memory);
+  return 0;
+}
+
+/*  Each byte that the first bytestring holds more often than the second
+    (surplus) has to be deleted or substituted, and each byte that it holds
+    less often (deficit) has to be inserted or substituted; one substitution
+    serves one of each. The cheapest way to serve them bounds the distance from
+    below.
+*/
+
+int get_weighted_lb_from_histograms(costs const * const costs_,
+                                    size_t const freq_buf_1[256],
+                                    size_t const freq_buf_2[256],
+                                    size_t * const bound) { /* lower bound */
+  size_t surplus = 0;
+  size_t deficit = 0;
+  size_t both = 0;
+  size_t bound_ = 0;
+  size_t t = 0;
+  size_t i = 0;
+
+  for (i = 0; i < 256; ++i) {
+    if (freq_buf_1[i] > freq_buf_2[i]) {
+      surplus += freq_buf_1[i] - freq_buf_2[i];
+    }
+    else {
+      deficit += freq_buf_2[i] - freq_buf_1[i];
+    }
+  }
+  both = minimum(surplus, deficit);
+
+  /* no substitutions */
+  if ( size_t_mul(&bound_, surplus, costs_->min_delete) ||
+       size_t_mul(&t, deficit, costs_->min_insert) ||
+       size_t_add_aug(&bound_, t) ) {
+    return 1;
+  }
+  /* as many substitutions as both serve */
+  if ( size_t_mul(&t, both, costs_->min_substitute) ||
+       size_t_add_aug(&t, (surplus - both) * (size_t)costs_->min_delete) ||
+       size_t_add_aug(&t, (deficit - both) * (size_t)costs_->min_insert) ) {
+    return 1;
+  }
+  bound_ = minimum(bound_, t);
+  /* substitutions only */
+  if ( size_t_mul(&t, maximum(surplus, deficit), costs_->min_substitute) ) {
+    return 1;
+  }
+  bound_ = minimum(bound_, t);
+
+  *bound = bound_;
+  return 0;
+}
+
+int get_weighted_lb(costs const * const costs_,
+                    buffer const * const buffer_1,
+                    buffer const * const buffer_2,
+                    size_t * const bound) { /* lower bound */
+  size_t freq_buf_1[256] = {0};
+  size_t freq_buf_2[256] = {0};
+
+  get_histogram(buffer_1, freq_buf_1);
+  get_histogram(buffer_2, freq_buf_2);
+  return get_weighted_lb_from_histograms(costs_, freq_buf_1, freq_buf_2, bound);
+}
+
+/*  get_weighted_ub sums the weighted distances of the chunks, like get_ld_ub. */
+
+int get_weighted_ub(costs const * const costs_,
+                    buffer const * const buffer_1,
+                    buffer const * const buffer_2,
+                    size_t * const bound) { /* upper bound */
+  size_t bound_ = 0;
+  size_t distance = 0;
+  buffer sub_buf_1 = {0};
+  buffer sub_buf_2 = {0};
+  size_t buf_1_t = buffer_1->size;
+  size_t buf_2_t = buffer_2->size;
+  int ret = 0;
+  STATS_TIMER(timer)
+
+  STATS_START(timer);
+  sub_buf_1.pointer = buffer_1->pointer;
+  sub_buf_2.pointer = buffer_2->pointer;
+  sub_buf_1.size = minimum(buf_1_t, 1024);
+  sub_buf_2.size = minimum(buf_2_t, 1024);
+
+  while (sub_buf_1.size ||
+         sub_buf_2.size) {
+    ret = get_weighted_distance(costs_, &sub_buf_1, &sub_buf_2, &distance);
+    if (ret) {
+      return ret;
+    }
+    ret = size_t_add_aug(&bound_, distance);
+    if (ret) {
+      return ret;
+    }
+
+    buf_1_t -= sub_buf_1.size;
+    buf_2_t -= sub_buf_2.size;
+    sub_buf_1.pointer += sub_buf_1.size;
+    sub_buf_2.pointer += sub_buf_2.size;
+    sub_buf_1.size = minimum(buf_1_t, sub_buf_1.size);
+    sub_buf_2.size = minimum(buf_2_t, sub_buf_2.size);
+  }
+
+  STATS_STOP(timer, STATS_CHUNKS);
+  *bound = bound_;
+  return 0;
+}
+
+/*  get_weighted_result computes the weighted distance (option 'd') or a bound
+    on it ('l', 'u').
+*/
+
+int get_weighted_result(costs const * const costs_,
+                        char const option,
+                        buffer const * const buffer_1,
+                        buffer const * const buffer_2,
+                        size_t * const result) {
+  switch (option) {
+  case 'd':
+    return get_weighted_distance(costs_, buffer_1, buffer_2, result);
+  case 'l':
+    return get_weighted_lb(costs_, buffer_1, buffer_2, result);
+  case 'u':
+    return get_weighted_ub(costs_, buffer_1, buffer_2, result);
+  }
+  return 1;
+}
+
+
+
+/*  Planning distance computations
+
+    get_planned_distance computes the distance of a measure with the metric
+    'l', 'i' or 'o' by the engine that a cost model expects to be fastest.
+    First, the common prefix and the common suffix of both bytestrings are
+    removed, since they do not change the distance. If one remainder is empty,
+    the distance is the size of the other one (engine "trivial"). Otherwise,
+    the engines are:
+     bit-parallel  the algorithm of Myers, in about s_1 * s_2 / 64 word steps
+                   for the sizes s_1 <= s_2 of the remainders;
+     diagonal      for the Levenshtein metric, the algorithm of Ukkonen and
+                   Myers, which extends the furthest reaching path on each
+                   diagonal for d = 0, 1, ... edits. It takes about d * d
+                   diagonal steps, plus slides along matching bytes, and wins
+                   by far if the distance is small compared with the sizes.
+    The distance is unknown beforehand, but get_ld_lb bounds it from below;
+    the bound takes about a word step per byte and four per bin of its
+    sketches. If the diagonal engine without edits (a step per 8 bytes of the
+    shorter remainder) and the bound together cost more than a quarter of the
+    bit-parallel engine, the bound is not computed, and the bit-parallel
+    engine is chosen; this spares small pairs, as in batches, the bound. If
+    the diagonal engine costs more than that quarter at the bound, the
+    bit-parallel engine is chosen as well. Otherwise, the diagonal
+    engine runs with a quarter of the bit-parallel cost as its budget, and the
+    bit-parallel engine takes over if the budget runs out; thus, a wrong
+    choice takes at most a quarter more time.
+    The costs per step come from a calibration: the defaults, or those that a
+    microbenchmark has measured and stored in a calibration file. Since they
+    depend on the processor, the file records the features of the processor
+    that they were measured on; on another one, they are measured again.
+    With a memory budget, an engine whose memory exceeds the budget is not
+    chosen. If the bit-parallel engine does not fit, the diagonal engine runs
+    with as many edits as its rows allow within the budget, and as many steps
+    as it takes, without a fallback.
+    With a threshold k, only whether the distance is at most k matters. The
+    diagonal engine then stops after k edits, and costs at most about
+    (k + 1) * (k + 1) diagonal steps; if that is less than the bit-parallel
+    cost, and its rows fit, it runs without a fallback, and a distance above k
+    is given as SIZE_MAX.
+*/
+
+typedef struct {
+  double bit_parallel_step; /* in nanoseconds, per word step */
+  double diagonal_step; /* in nanoseconds */
+  char features[64]; /* of the processor */
+} calibration;
+
+typedef struct {
+  size_t prefix_size;
+  size_t suffix_size;
+  buffer remainders[2]; /* views; their hashes are unset */
+  size_t alphabet_size; /* of the shorter remainder */
+  size_t lower_bound;
+  int lower_bounded; /* whether the lower bound was computed */
+  double bit_parallel_cost; /* estimated, in nanoseconds */
+  double diagonal_cost; /* estimated at the lower bound */
+  double bit_parallel_memory; /* estimated, in bytes */
+  double diagonal_memory; /* estimated at the lower bound */
+  size_t max_distance; /* the edits that the rows of the diagonal engine allow */
+  size_t max_steps; /* the budget of the diagonal engine */
+  int fallback; /* whether the bit-parallel engine takes over */
+  int thresholded; /* whether a distance above max_distance is SIZE_MAX */
+  char engine; /* 't' (trivial), 'g' (diagonal), 'b' (bit-parallel), or 'n'
+                  (none, within the memory budget) */
+} plan;
+
+/*  get_square_root returns the square root of op, rounded down. */
+
+size_t get_square_root(size_t const op) {
+  size_t root = op / 2 + 1; /* not less than the square root */
+  size_t next = 0;
+
+  if (op < 2) {
+    return op;
+  }
+  next = (root + op / root) / 2;
+  while (next < root) {
+    root = next;
+    next = (root + op / root) / 2;
+  }
+  return root;
+}
+
+void get_processor_features(char * const features,
+                            size_t const size) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  __builtin_cpu_init();
+  snprintf(features, size, "x86%s%s%s%s",
+           __builtin_cpu_supports("sse4.2") ? "+sse4.2" : "",
+           __builtin_cpu_supports("popcnt") ? "+popcnt" : "",
+           __builtin_cpu_supports("avx2") ? "+avx2" : "",
+           __builtin_cpu_supports("avx512f") ? "+avx512f" : "");
+#elif defined(__aarch64__) || defined(_M_ARM64)
+  snprintf(features, size, "arm64");
+#else
+  snprintf(features, size, "generic");
+#endif
+}
+
+void calibration_default(calibration * const calibration_) {
+  memset( calibration_, 0, sizeof(*calibration_) );
+  calibration_->bit_parallel_step = 1.0;
+  calibration_->diagonal_step = 2.5;
+}
+
+/*  get_diagonal_distance computes the Levenshtein distance by the diagonal
+    engine. If the distance exceeds max_distance, or if the computation takes
+    more than max_steps steps, it stops and sets *distance to SIZE_MAX. The
+    rows that the furthest reaching paths have reached on the diagonals
+    k = j - i are kept for the diagonals -d_max, ..., d_max, where
+    d_max <= max_distance and d_max * d_max <= max_steps; -1 means none.
+*/
+
+int get_diagonal_distance(buffer const * const buffer_1,
+                          buffer const * const buffer_2,
+                          size_t const max_distance,
+                          size_t const max_steps,
+                          size_t * const distance) {
+  ptrdiff_t const size_1 = (ptrdiff_t)buffer_1->size;
+  ptrdiff_t const size_2 = (ptrdiff_t)buffer_2->size;
+  ptrdiff_t const last = size_2 - size_1; /* the diagonal of the end */
+  ptrdiff_t d_max = 0;
+  ptrdiff_t * storage = NULL;
+  ptrdiff_t * rows = NULL;
+  ptrdiff_t * previous = NULL;
+  ptrdiff_t * swap = NULL;
+  ptrdiff_t d = 0;
+  ptrdiff_t k = 0;
+  ptrdiff_t r = 0;
+  ptrdiff_t start = 0;
+  size_t steps = 0;
+  STATS_TIMER(timer)
+
+  d_max = (ptrdiff_t)minimum( minimum(get_square_root(max_steps), max_distance),
+                              maximum(buffer_1->size, buffer_2->size) );
+  *distance = SIZE_MAX;
+  if (last > d_max || -last > d_max) {
+    return 0;
+  }
+  storage = stats_malloc( 2 * (2 * d_max + 3) * sizeof(*storage) );
+  if (!storage) {
+    return 1;
+  }
+  STATS_START(timer);
+  for (k = 0; k < 2 * (2 * d_max + 3); ++k) {
+    storage[k] = -1;
+  }
+  /* Both point to the diagonal 0. */
+  rows = storage + d_max + 1;
+  previous = rows + 2 * d_max + 3;
+
+  for (d = 0; d <= d_max; ++d) {
+    for (k = d < size_1 ? -d : -size_1; k <= d && k <= size_2; ++k) {
+      r = d ? -1 : 0;
+      if (previous[k] >= 0) {
+        r = previous[k] + 1; /* substitution */
+      }
+      if (previous[k + 1] >= 0 && r < previous[k + 1] + 1) {
+        r = previous[k + 1] + 1; /* deletion */
+      }
+      if (previous[k - 1] >= 0 && r < previous[k - 1]) {
+        r = previous[k - 1]; /* insertion */
+      }
+      /* A path that reaches beyond the end reaches the end, too. */
+      if (r > size_1) {
+        r = size_1;
+      }
+      if (r > size_2 - k) {
+        r = size_2 - k;
+      }
+      start = r;
+      while ( r >= 0 && r + 8 <= size_1 && r + k + 8 <= size_2 &&
+              !memcmp(buffer_1->pointer + r, buffer_2->pointer + r + k, 8) ) {
+        r += 8;
+      }
+      while ( r >= 0 && r < size_1 && r + k < size_2 &&
+              buffer_1->pointer[r] == buffer_2->pointer[r + k] ) {
+        ++r;
+      }
+      rows[k] = r;
+      steps += 1 + (size_t)(r - start) / 8;
+    }
+    if (rows[last] == size_1) {
+      *distance = (size_t)d;
+      break;
+    }
+    if (steps > max_steps) {
+      break;
+    }
+    swap = previous;
+    previous = rows;
+    rows = swap;
+  }
+
+  STATS_STOP(timer, STATS_DP);
+  STATS_COUNT(STATS_CELLS, steps);
+  free(storage);
+  return 0;
+}
+
+/*  calibration_measure times both engines on pseudorandom bytestrings over
+    four bytes, like DNA.
+*/
+
+void calibration_fill(char * const pointer,
+                      size_t const size,
+                      uint64_t const seed) {
+  size_t i = 0;
+
+  for (i = 0; i < size; ++i) {
+    pointer[i] = "ACGT"[uint64_fmix(seed << 56 ^ i) & 3];
+  }
+}
+
+int calibration_measure(calibration * const calibration_) {
+  size_t const pattern_size = 4096;
+  size_t const text_size = (size_t)1 << 17;
+  buffer buffers[2];
+  char * storage = NULL;
+  clock_t begin = 0;
+  double elapsed = 0;
+  size_t distance = 0;
+  int ret = 0;
+
+  storage = stats_malloc(pattern_size + text_size);
+  if (!storage) {
+    return 1;
+  }
+  memset( buffers, 0, sizeof(buffers) );
+  buffers[0].pointer = storage;
+  buffers[0].size = pattern_size;
+  buffers[1].pointer = storage + pattern_size;
+  buffers[1].size = text_size;
+  calibration_fill(buffers[0].pointer, buffers[0].size, 1);
+  calibration_fill(buffers[1].pointer, buffers[1].size, 2);
+
+  begin = clock();
+  ret = get_distance_bit_parallel('l', &buffers[0], &buffers[1], &distance);
+  elapsed = (double)(clock() - begin) / CLOCKS_PER_SEC;
+  if (!ret && elapsed > 0) {
+    calibration_->bit_parallel_step = elapsed * 1e9 /
+      ( (double)get_word_count(pattern_size) * text_size );
+  }
+
+  buffers[1].size = pattern_size;
+  begin = clock();
+  ret = ret || get_diagonal_distance(&buffers[0], &buffers[1], SIZE_MAX, SIZE_MAX,
+                                      &distance);
+  elapsed = (double)(clock() - begin) / CLOCKS_PER_SEC;
+  if (!ret && elapsed > 0) {
+    calibration_->diagonal_step = elapsed * 1e9 /
+      ( ((double)distance + 1) * ((double)distance + 1) );
+  }
+
+  free(storage);
+  return ret;
+}
+
+void calibration_destroy(calibration * const calibration_) {
+  free(calibration_);
+}
+
+/*  calibration_create reads the calibration file, whose lines hold a key and
+    a value each. If the file is missing, or if it was written on another
+    processor, the speeds are measured and the file is (re)written.
+*/
+
+int calibration_create(char const * const file_path,
+                       calibration ** const calibration__) {
+  calibration * calibration_ = NULL;
+  FILE * file = NULL;
+  char line[256];
+  char key[64];
+  char value[64];
+  char features[64];
+  int found = 0;
+  int ret = 0;
+
+  calibration_ = stats_calloc( 1, sizeof(*calibration_) );
+  if (!calibration_) {
+    return 1;
+  }
+  calibration_default(calibration_);
+  get_processor_features( calibration_->features, sizeof(calibration_->features) );
+  memset( features, 0, sizeof(features) );
+
+  file = fopen(file_path, "r");
+  if (file) {
+    while ( fgets(line, sizeof(line), file) ) {
+      if (sscanf(line, "%63s %63s", key, value) != 2) {
+        continue;
+      }
+      if ( !strcmp(key, "features") ) {
+        memcpy(features, value, sizeof(features));
+        found |= 1;
+      }
+      else if ( !strcmp(key, "bit_parallel_step") ) {
+        calibration_->bit_parallel_step = strtod(value, NULL);
+        found |= 2;
+      }
+      else if ( !strcmp(key, "diagonal_step") ) {
+        calibration_->diagonal_step = strtod(value, NULL);
+        found |= 4;
+      }
+    }
+    fclose(file);
+  }
+  if ( found == 7 &&
+       !strcmp(features, calibration_->features) &&
+       calibration_->bit_parallel_step > 0 &&
+       calibration_->diagonal_step > 0 ) {
+    *calibration__ = calibration_;
+    return 0;
+  }
+
+  ret = calibration_measure(calibration_);
+  if (ret) {
+    calibration_destroy(calibration_);
+    return ret;
+  }
+  file = fopen(file_path, "w");
+  ret = !file ||
+        fprintf(file, "features %s\nbit_parallel_step %.6f\ndiagonal_step %.6f\n",
+                calibration_->features, calibration_->bit_parallel_step,
+                calibration_->diagonal_step) < 0;
+  if (file) {
+    ret = fclose(file) || ret;
+  }
+  if (ret) {
+    fprintf(stderr, "Warning: Could not write calibration.\n");
+  }
+
+  *calibration__ = calibration_;
+  return 0;
+}
+
+/*  get_diagonal_memory returns the memory of the rows of the diagonal engine,
+    for up to d_max edits.
+*/
+
+double get_diagonal_memory(double const d_max) {
+  return 2 * (2 * d_max + 3) * sizeof(ptrdiff_t);
+}
+
+/*  get_remainders removes the common prefix and the common suffix of both
+    bytestrings; the remainders are views, whose hashes are unset.
+*/
+
+void get_remainders(buffer const * const buffer_1,
+                    buffer const * const buffer_2,
+                    size_t * const prefix_size,
+                    size_t * const suffix_size,
+                    buffer remainders[2]) {
+  size_t const size = minimum(buffer_1->size, buffer_2->size);
+  size_t const prefix_size_ = get_common_prefix_size(buffer_1, buffer_2);
+  size_t suffix_size_ = 0;
+
+  while ( suffix_size_ < size - prefix_size_ &&
+          buffer_1->pointer[buffer_1->size - 1 - suffix_size_] ==
+          buffer_2->pointer[buffer_2->size - 1 - suffix_size_] ) {
+    ++suffix_size_;
+  }
+  memset( remainders, 0, 2 * sizeof(*remainders) );
+  remainders[0].pointer = buffer_1->pointer + prefix_size_;
+  remainders[0].size = buffer_1->size - prefix_size_ - suffix_size_;
+  remainders[1].pointer = buffer_2->pointer + prefix_size_;
+  remainders[1].size = buffer_2->size - prefix_size_ - suffix_size_;
+  *prefix_size = prefix_size_;
+  *suffix_size = suffix_size_;
+}
+
+/*  get_plan chooses the engine for the metric and the bytestrings; the
+    calibration may be NULL, and a max_memory of 0 means no budget. If
+    lower_bound is not NULL, it points to the lower bound of get_ld_lb for the
+    remainders, which is then not computed again. The threshold is SIZE_MAX
+    for none.
+*/
+
+int get_plan(char const metric,
+             calibration const * const calibration_,
+             size_t const max_memory,
+             buffer const * const buffer_1,
+             buffer const * const buffer_2,
+             size_t const * const lower_bound,
+             size_t const threshold,
+             plan * const plan_) {
+  calibration defaults;
+  calibration const * speeds = calibration_;
+  buffer const * shorter = NULL;
+  size_t words = 0;
+  double steps = 0;
+  double t = 0;
+  double k = 0;
+  int fits = 0;
+  int ret = 0;
+
+  if (!speeds) {
+    calibration_default(&defaults);
+    speeds = &defaults;
+  }
+  memset( plan_, 0, sizeof(*plan_) );
+  get_remainders(buffer_1, buffer_2, &plan_->prefix_size, &plan_->suffix_size,
+                 plan_->remainders);
+  if (!plan_->remainders[0].size || !plan_->remainders[1].size) {
+    plan_->engine = 't';
+    return 0;
+  }
+
+  shorter = &plan_->remainders[plan_->remainders[1].size < plan_->remainders[0].size];
+  plan_->alphabet_size = get_alphabet_size(shorter->pointer, shorter->size);
+  words = get_word_count(shorter->size);
+  plan_->bit_parallel_cost = speeds->bit_parallel_step * (double)words *
+    ( (double)(plan_->remainders[0].size + plan_->remainders[1].size - shorter->size) +
+      (double)plan_->alphabet_size + 1 );
+  plan_->bit_parallel_memory = (double)sizeof(uint64_t) * (double)words *
+                                (double)(plan_->alphabet_size + 1 + 4);
+  fits = !max_memory || plan_->bit_parallel_memory <= (double)max_memory;
+  plan_->engine = fits ? 'b' : 'n';
+  if (metric != 'l') {
+    return 0;
+  }
+  /* The diagonal engine keeps two rows per diagonal; for up to
+     (size_1 + size_2) / 16 edits, they take up to twice the size of both
+     bytestrings. Within a budget, its rows must fit, too.
+  */
+  t = (double)SIZE_MAX;
+  if (max_memory) {
+    t = ((double)max_memory / (2 * sizeof(ptrdiff_t)) - 3) / 2;
+    t = t > 0 ? t : 0;
+  }
+  if (threshold != SIZE_MAX) {
+    k = (double)minimum( threshold, maximum(buffer_1->size, buffer_2->size) );
+    if ( k <= t &&
+         (!fits ||
+          speeds->diagonal_step * ( (k + 1) * (k + 1) + (double)shorter->size / 8 ) <
+          plan_->bit_parallel_cost) ) {
+      plan_->engine = 'g';
+      plan_->max_distance = (size_t)k;
+      plan_->max_steps = SIZE_MAX;
+      plan_->thresholded = 1;
+      return 0;
+    }
+  }
+  if ( fits && !lower_bound &&
+       plan_->bit_parallel_cost / 4 <
+       speeds->diagonal_step * (1 + (double)shorter->size / 8) +
+       speeds->bit_parallel_step *
+       ( (double)(plan_->remainders[0].size + plan_->remainders[1].size) +
+         4 * SKETCH_BINS ) ) {
+    return 0;
+  }
+
+  plan_->lower_bounded = 1;
+  if (lower_bound) {
+    plan_->lower_bound = *lower_bound;
+  }
+  else {
+    ret = get_ld_lb('l', &plan_->remainders[0], &plan_->remainders[1],
+                    &plan_->lower_bound);
+    if (ret) {
+      return ret;
+    }
+  }
+  plan_->diagonal_cost = speeds->diagonal_step *
+    ( ((double)plan_->lower_bound + 1) * ((double)plan_->lower_bound + 1) +
+      (double)shorter->size / 8 );
+  plan_->diagonal_memory = get_diagonal_memory( (double)plan_->lower_bound );
+  if (!fits) {
+    if ( plan_->diagonal_memory <= (double)max_memory ) {
+      plan_->engine = 'g';
+      plan_->max_distance = (size_t)t;
+      plan_->max_steps = SIZE_MAX;
+    }
+  }
+  else if (plan_->diagonal_cost <= plan_->bit_parallel_cost / 4) {
+    plan_->engine = 'g';
+    if ( t > (double)(buffer_1->size + buffer_2->size) / 16 ) {
+      t = (double)(buffer_1->size + buffer_2->size) / 16;
+    }
+    plan_->max_distance = (size_t)t;
+    steps = plan_->bit_parallel_cost / 4 / speeds->diagonal_step;
+    plan_->max_steps = steps < (double)SIZE_MAX ? (size_t)steps : SIZE_MAX;
+    plan_->fallback = 1;
+  }
+  return 0;
+}
+
+char const * get_engine_name(char const engine) {
+  switch (engine) {
+  case 't':
+    return "trivial";
+  case 'g':
+    return "diagonal";
+  case 'n':
+    return "none";
+  }
+  return "bit-parallel";
+}
+
+void plan_print(plan const * const plan_,
+                FILE * const file) {
+  fprintf(file, "Plan: common prefix %" SIZE_T_FORMAT ", common suffix %"
+          SIZE_T_FORMAT ", remainders %" SIZE_T_FORMAT " and %"
+          SIZE_T_FORMAT " bytes.\n",
+          plan_->prefix_size, plan_->suffix_size,
+          plan_->remainders[0].size, plan_->remainders[1].size);
+  if (plan_->engine != 't' && !plan_->lower_bounded) {
+    fprintf(file, "Plan: alphabet size %" SIZE_T_FORMAT ", no lower bound.\n",
+            plan_->alphabet_size);
+    fprintf(file, "Plan: bit-parallel %.3f s and %.0f bytes.\n",
+            plan_->bit_parallel_cost / 1e9, plan_->bit_parallel_memory);
+  }
+  else if (plan_->engine != 't') {
+    fprintf(file, "Plan: alphabet size %" SIZE_T_FORMAT ", lower bound %"
+            SIZE_T_FORMAT ".\n", plan_->alphabet_size, plan_->lower_bound);
+    fprintf(file, "Plan: bit-parallel %.3f s and %.0f bytes, diagonal at least "
+            "%.3f s and %.0f bytes.\n",
+            plan_->bit_parallel_cost / 1e9, plan_->bit_parallel_memory,
+            plan_->diagonal_cost / 1e9, plan_->diagonal_memory);
+  }
+  fprintf(file, "Plan: engine %s", get_engine_name(plan_->engine));
+  if (plan_->engine == 'g' && plan_->thresholded) {
+    fprintf(file, " (up to the threshold of %" SIZE_T_FORMAT " edits)",
+            plan_->max_distance);
+  }
+  else if (plan_->engine == 'g' && plan_->fallback) {
+    fprintf(file, " (up to %" SIZE_T_FORMAT " edits and %" SIZE_T_FORMAT
+            " steps)", plan_->max_distance, plan_->max_steps);
+  }
+  else if (plan_->engine == 'g') {
+    fprintf(file, " (up to %" SIZE_T_FORMAT " edits, within the memory budget)",
+            plan_->max_distance);
+  }
+  fprintf(file, ".\n");
+}
+
+/*  plan_run computes the distance of the metric by the plan; if the diagonal
+    engine falls back, the engine of the plan becomes 'b'. Unless explain is
+    NULL, it prints the fallback to explain.
+*/
+
+int plan_run(plan * const plan_,
+             char const metric,
+             FILE * const explain,
+             size_t * const distance) {
+  int ret = 0;
+
+  switch (plan_->engine) {
+  case 't':
+    *distance = plan_->remainders[0].size + plan_->remainders[1].size;
+    return 0;
+  case 'n':
+    return 1;
+  case 'g':
+    ret = get_diagonal_distance(&plan_->remainders[0], &plan_->remainders[1],
+                                plan_->max_distance, plan_->max_steps, distance);
+    if (ret || *distance != SIZE_MAX || plan_->thresholded) {
+      return ret;
+    }
+    if (!plan_->fallback) {
+      fprintf(stderr, "Error: The distance needs more memory than the budget.\n");
+      return 1;
+    }
+    if (explain) {
+      fprintf(explain, "Plan: The diagonal engine ran out of steps; engine "
+              "bit-parallel.\n");
+    }
+    plan_->engine = 'b';
+  }
+  return get_distance_bit_parallel(metric, &plan_->remainders[0], &plan_->remainders[1],
+                                   distance);
+}
+
+/*  get_planned_distance computes the distance of the metric; unless explain is
+    NULL, it prints the plan, and its outcome, to explain. With a threshold
+    (SIZE_MAX for none), a distance above it may be given as SIZE_MAX.
+*/
+
+int get_planned_distance(char const metric,
+                         calibration const * const calibration_,
+                         size_t const max_memory,
+                         buffer const * const buffer_1,
+                         buffer const * const buffer_2,
+                         size_t const threshold,
+                         FILE * const explain,
+                         size_t * const distance) {
+  plan plan_;
+  int ret = 0;
+
+  ret = get_plan(metric, calibration_, max_memory, buffer_1, buffer_2, NULL,
+                 threshold, &plan_);
+  if (ret) {
+    return ret;
+  }
+  if (explain) {
+    plan_print(&plan_, explain);
+  }
+  return plan_run(&plan_, metric, explain, distance);
+}
+
+
+
+/*  Measures
+
+    A measure selects a computation: its option is 'd' (distance), 'l' (lower
+    bound) or 'u' (upper bound), and its metric is 'l' (Levenshtein), 'i'
+    (indel), 'o' (optimal string alignment) or 'w' (weighted, by the costs).
+*/
+
+typedef struct {
+  char option;
+  char metric;
+  costs const * costs_; /* for the metric 'w' */
+  calibration const * calibration_; /* for planning; may be NULL */
+  size_t max_memory; /* of a computation; 0 if unlimited */
+} measure;
+
+/*  measure_key identifies the measure in caches. For the Levenshtein metric,
+    it is the option alone, so that existing cache files stay valid; for the
+    metric 'w', it includes the key of the costs. The lower bounds of the
+    metrics 'l' and 'o' carry MEASURE_LB_VERSION in the top byte, since the
+    sketch bound changed them; cached bounds of older versions are not found.
+*/
+
+#define MEASURE_LB_VERSION 1
+
+uint64_t measure_key(measure const * const measure_) {
+  uint64_t key = (unsigned char)measure_->option;
+
+  if (measure_->metric != 'l') {
+    key |= (uint64_t)(unsigned char)measure_->metric << 8;
+  }
+  if (measure_->metric == 'w') {
+    key |= measure_->costs_->key << 16;
+  }
+  else if (measure_->option == 'l' && measure_->metric != 'i') {
+    key |= (uint64_t)MEASURE_LB_VERSION << 56;
+  }
+  return key;
+}
+
+/*  get_lb_from_histograms computes the histogram bound for the measure. */
+
+int get_lb_from_histograms(measure const * const measure_,
+                           size_t const freq_buf_1[256],
+                           size_t const size_1,
+                           size_t const freq_buf_2[256],
+                           size_t const size_2,
+                           size_t * const bound) { /* lower bound */
+  switch (measure_->metric) {
+  case 'l':
+  case 'o':
+    return get_ld_lb_from_histograms(freq_buf_1, size_1, freq_buf_2, size_2, bound);
+  case 'i':
+    return get_indel_lb_from_histograms(freq_buf_1, freq_buf_2, bound);
+  case 'w':
+    return get_weighted_lb_from_histograms(measure_->costs_, freq_buf_1, freq_buf_2,
+                                           bound);
+  }
+  return 1;
+}
+
+/*  get_lb_from_summaries computes the lower bound of the option 'l' from the
+    byte histograms, the sketches and the sizes of both bytestrings. Only the
+    metrics 'l' and 'o' use the sketches; for the others, they may be NULL.
+*/
+
+int get_lb_from_summaries(measure const * const measure_,
+                          size_t const freq_buf_1[256],
+                          size_t const * const sketch_1,
+                          size_t const size_1,
+                          size_t const freq_buf_2[256],
+                          size_t const * const sketch_2,
+                          size_t const size_2,
+                          size_t * const bound) { /* lower bound */
+  size_t bound_ = 0;
+  size_t t = 0;
+  int ret = 0;
+
+  ret = get_lb_from_histograms(measure_, freq_buf_1, size_1, freq_buf_2, size_2,
+                               &bound_);
+  if (ret) {
+    return ret;
+  }
+  if (measure_->metric == 'l' || measure_->metric == 'o') {
+    ret = get_ld_lb_from_sketches(measure_->metric, sketch_1, size_1,
+                                  sketch_2, size_2, &t);
+    if (ret) {
+      return ret;
+    }
+    if (bound_ < t) {
+      bound_ = t;
+    }
+  }
+
+  *bound = bound_;
+  return 0;
+}
+
+
+
+/*  Mapping files
+
+    A mapping makes the content of a file available in memory, read-only: on
+    Linux, the file is mapped; elsewhere, it is read into a buffer. A shared
+    mapping can also be written to with mapping_write: on Linux, the file is
+    mapped shared, so that the writes reach the file and the mappings of other
+    processes; elsewhere, the writes go to the buffer and through to the file.
+*/
+
+typedef struct {
+  char const * pointer;
+  size_t size;
+  buffer * buffer_; /* only if the file is not mapped */
+  FILE * file; /* only if the mapping is shared, but the file is not mapped */
+} mapping;
+
+void mapping_destroy(mapping * const mapping_) {
+  if (mapping_) {
+#ifdef __linux__
+    if (!mapping_->buffer_ && mapping_->size) {
+      munmap((void *)mapping_->pointer, mapping_->size);
+    }
+#endif
+    if (mapping_->file) {
+      fclose(mapping_->file);
+    }
+    buffer_destroy(mapping_->buffer_);
+  }
+  free(mapping_);
+}
+
+int mapping_create(char const * const file_path,
+                   mapping ** const mapping_) {
+  mapping * map = NULL;
+  int ret = 0;
+  STATS_TIMER(timer)
+
+  map = stats_calloc( 1, sizeof(*map) );
+  if (!map) {
+    return 1;
+  }
+#ifdef __linux__
+  {
+    struct stat status;
+    void * pointer = NULL;
+    int const fd = open(file_path, O_RDONLY | O_CLOEXEC);
+
+    STATS_START(timer);
+    if (fd < 0) {
+      free(map);
+      return 1;
+    }
+    if ( fstat(fd, &status) ||
+         !S_ISREG(status.st_mode) ||
+         (uint64_t)status.st_size > SIZE_MAX ) {
+      close(fd);
+      free(map);
+      return 1;
+    }
+    map->size = (size_t)status.st_size;
+    STATS_STOP(timer, STATS_SIZE);
+    STATS_START(timer);
+    if (map->size) {
+      pointer = mmap(NULL, map->size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (pointer == MAP_FAILED) {
+        close(fd);
+        free(map);
+        return 1;
+      }
+      map->pointer = pointer;
+    }
+    close(fd);
+    STATS_STOP(timer, STATS_READ);
+    STATS_COUNT(STATS_BYTES_READ, map->size);
+  }
+#else
+  ret = buffer_create(file_path, SIZE_MAX, &map->buffer_);
+  if (ret) {
+    free(map);
+    return ret;
+  }
+  map->pointer = map->buffer_->pointer;
+  map->size = map->buffer_->size;
+#endif
+  (void)ret;
+
+  *mapping_ = map;
+  return 0;
+}
+
+char * string_copy(char const * const string) {
+  size_t const size = strlen(string) + 1;
+  char * copy = NULL;
+
+  copy = stats_malloc(size);
+  if (copy) {
+    memcpy(copy, string, size);
+  }
+  return copy;
+}
+
+int mapping_create_shared(char const * const file_path,
+                          mapping ** const mapping_) {
+  mapping * map = NULL;
+  int ret = 0;
+
+  map = stats_calloc( 1, sizeof(*map) );
+  if (!map) {
+    return 1;
+  }
+#ifdef __linux__
+  {
+    struct stat status;
+    void * pointer = NULL;
+    int const fd = open(file_path, O_RDWR | O_CLOEXEC);
+
+    if (fd < 0) {
+      free(map);
+      return 1;
+    }
+    if ( fstat(fd, &status) ||
+         !S_ISREG(status.st_mode) ||
+         (uint64_t)status.st_size > SIZE_MAX ) {
+      close(fd);
+      free(map);
+      return 1;
+    }
+    map->size = (size_t)status.st_size;
+    if (map->size) {
+      pointer = mmap(NULL, map->size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+      if (pointer == MAP_FAILED) {
+        close(fd);
+        free(map);
+        return 1;
+      }
+      map->pointer = pointer;
+    }
+    close(fd);
+  }
+#else
+  ret = buffer_create(file_path, SIZE_MAX, &map->buffer_);
+  if (!ret) {
+    map->file = fopen(file_path, "r+b");
+    ret = !map->file;
+  }
+  if (ret) {
+    buffer_destroy(map->buffer_);
+    free(map);
+    return 1;
+  }
+  map->pointer = map->buffer_->pointer;
+  map->size = map->buffer_->size;
+#endif
+  (void)ret;
+
+  *mapping_ = map;
+  return 0;
+}
+
+/*  mapping_write copies the bytes into the shared mapping at the offset. */
+
+int mapping_write(mapping * const mapping_,
+                  size_t const offset,
+                  void const * const bytes,
+                  size_t const size) {
+  if (offset > mapping_->size || size > mapping_->size - offset) {
+    return 1;
+  }
+  memcpy( (char *)mapping_->pointer + offset, bytes, size );
+  if (mapping_->file) {
+    return fseek(mapping_->file, (long int)offset, SEEK_SET) ||
+           size != fwrite(bytes, 1, size, mapping_->file) ||
+           fflush(mapping_->file);
+  }
+  return 0;
+}
+
+/*  buffer_map maps the file and makes the buffer refer to the mapping, up to
+    the first max_size bytes; unlike the pages of a buffer that was read, the
+    pages of the mapping can be dropped and reread under memory pressure.
+    buffer_unmap releases both; without a mapping, it destroys the buffer.
+*/
+
+int buffer_map(char const * const file_path,
+               size_t const max_size,
+               mapping ** const mapping_,
+               buffer ** const buffer_) {
+  buffer * buf = NULL;
+  int ret = 0;
+
+  buf = stats_calloc( 1, sizeof(*buf) );
+  if (!buf) {
+    return 1;
+  }
+  ret = mapping_create(file_path, mapping_);
+  if (ret) {
+    free(buf);
+    return ret;
+  }
+  buf->pointer = (char *)(*mapping_)->pointer;
+  buf->size = minimum( (*mapping_)->size, max_size );
+  hash_128(buf->pointer, buf->size, buf->hash);
+
+  *buffer_ = buf;
+  return 0;
+}
+
+void buffer_unmap(buffer * const buffer_,
+                  mapping * const mapping_) {
+  if (mapping_) {
+    free(buffer_);
+    mapping_destroy(mapping_);
+  }
+  else {
+    buffer_destroy(buffer_);
+  }
+}
+
+
+
+/*  Profiles
+
+    A profile holds everything that comparisons need from one bytestring, the
+    reference, precomputed: its hash, byte histogram, sketch, and match masks,
+    followed by the bytestring itself. A profile file consists of a header
+    (profile_header) and the following arrays, in native byte order:
+      - uint64_t histogram[256]
+      - uint64_t sketch[sketch_bins]
+      - uint64_t masks[row_count * word_count]
+      - char content[size]
+    Since all arrays consist of 64-bit words, the file can be mapped as is;
+    only the histogram and the sketch are copied when a profile is loaded.
+    The rows of the masks follow from the histogram (see set_rows).
+*/
+
+#define PROFILE_MAGIC UINT64_C(0x32666f72706c62) /* "blprof2" */
+#define PROFILE_BYTE_ORDER UINT64_C(0x0102030405060708)
+
+typedef struct {
+  uint64_t magic;
+  uint64_t byte_order;
+  uint64_t size; /* of the reference, after applying the read limit */
+  uint64_t hash[2];
+  uint64_t sketch_bins;
+  uint64_t word_count;
+  uint64_t row_count;
+} profile_header;
+
+typedef struct {
+  mapping * mapping_;
+  buffer content; /* points into the mapping */
+  size_t histogram[256];
+  size_t sketch[SKETCH_BINS];
+  match_masks masks; /* points into the mapping */
+} profile;
+
+int write_uint64s(FILE * const file,
+                  size_t const * const values,
+                  size_t const count) {
+  uint64_t value = 0;
+  size_t i = 0;
+
+  for (i = 0; i < count; ++i) {
+    value = values[i];
+    if ( 1 != fwrite(&value, sizeof(value), 1, file) ) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int profile_write(buffer const * const buffer_,
+                  char const * const file_path) {
+  profile_header header = {0};
+  match_masks * masks = NULL;
+  size_t * counts = NULL;
+  FILE * file = NULL;
+  int ret = 0;
+
+  counts = stats_calloc( 256 + SKETCH_BINS, sizeof(*counts) );
+  if (!counts) {
+    return 1;
+  }
+  ret = match_masks_create(buffer_->size,
+                           get_alphabet_size(buffer_->pointer, buffer_->size),
+                           &masks);
+  if (ret) {
+    free(counts);
+    return ret;
+  }
+  match_masks_fill(masks, buffer_->pointer, buffer_->size);
+  get_histogram(buffer_, counts);
+  get_sketch(buffer_, counts + 256);
+
+  header.magic = PROFILE_MAGIC;
+  header.byte_order = PROFILE_BYTE_ORDER;
+  header.size = buffer_->size;
+  header.hash[0] = buffer_->hash[0];
+  header.hash[1] = buffer_->hash[1];
+  header.sketch_bins = SKETCH_BINS;
+  header.word_count = masks->stride;
+  header.row_count = masks->row_count;
+
+  file = fopen(file_path, "wb");
+  ret = !file ||
+        1 != fwrite(&header, sizeof(header), 1, file) ||
+        write_uint64s(file, counts, 256 + SKETCH_BINS) ||
+        masks->row_count * masks->stride !=
+          fwrite(masks->words, sizeof(*masks->words),
+                 masks->row_count * masks->stride, file) ||
+        buffer_->size && buffer_->size != fwrite(buffer_->pointer, 1, buffer_->size, file);
+  if (file && fclose(file)) {
+    ret = 1;
+  }
+
+  match_masks_destroy(masks);
+  free(counts);
+  return ret;
+}
+
+void profile_destroy(profile * const profile_) {
+  if (profile_) {
+    mapping_destroy(profile_->mapping_);
+  }
+  free(profile_);
+}
+
+int profile_create(char const * const file_path,
+                   profile ** const profile_) {
+  profile * prof = NULL;
+  profile_header header = {0};
+  uint64_t const * values = NULL;
+  size_t expected = 0;
+  size_t i = 0;
+  int ret = 0;
+
+  prof = stats_calloc( 1, sizeof(*prof) );
+  if (!prof) {
+    return 1;
+  }
+  ret = mapping_create(file_path, &prof->mapping_);
+  if (ret) {
+    free(prof);
+    return ret;
+  }
+  if (prof->mapping_->size >= sizeof(header)) {
+    memcpy( &header, prof->mapping_->pointer, sizeof(header) );
+  }
+  if ( header.magic != PROFILE_MAGIC ||
+       header.byte_order != PROFILE_BYTE_ORDER ||
+       header.sketch_bins != SKETCH_BINS ||
+       header.size > SIZE_MAX ||
+       header.word_count != get_word_count((size_t)header.size) ||
+       header.row_count == 0 ||
+       header.row_count > 257 ) {
+    profile_destroy(prof);
+    return 1;
+  }
+  expected = 256 + SKETCH_BINS;
+  if ( size_t_mul(&i, (size_t)header.row_count, (size_t)header.word_count) ||
+       size_t_add_aug(&expected, i) ||
+       size_t_mul_aug( &expected, sizeof(uint64_t) ) ||
+       size_t_add_aug( &expected, sizeof(header) ) ||
+       size_t_add_aug(&expected, (size_t)header.size) ||
+       expected != prof->mapping_->size ) {
+    profile_destroy(prof);
+    return 1;
+  }
+
+  values = (uint64_t const *)(prof->mapping_->pointer + sizeof(header));
+  for (i = 0; i < 256; ++i) {
+    prof->histogram[i] = (size_t)values[i];
+  }
+  for (i = 0; i < SKETCH_BINS; ++i) {
+    prof->sketch[i] = (size_t)values[256 + i];
+  }
+  prof->masks.row_count = set_rows(prof->histogram, prof->masks.rows);
+  if (prof->masks.row_count != header.row_count) {
+    profile_destroy(prof);
+    return 1;
+  }
+  prof->masks.row_capacity = prof->masks.row_count;
+  prof->masks.words = values + 256 + SKETCH_BINS;
+  prof->masks.stride = (size_t)header.word_count;
+  prof->masks.size = (size_t)header.size;
+  prof->content.pointer = (char *)(prof->masks.words +
+                                   prof->masks.row_count * prof->masks.stride);
+  prof->content.size = (size_t)header.size;
+  prof->content.hash[0] = header.hash[0];
+  prof->content.hash[1] = header.hash[1];
+
+  *profile_ = prof;
+  return 0;
+}
+
+/*  get_profile_result computes the same result as get_result, with the
+    reference given by its profile.
+*/
+
+int get_profile_result(measure const * const measure_,
+                       profile const * const profile_,
+                       buffer const * const buffer_,
+                       size_t * const result) {
+  size_t histogram[256] = {0};
+  size_t sketch[SKETCH_BINS] = {0};
+  int ret = 0;
+  STATS_TIMER(timer)
+
+  if ( buffer_identical(&profile_->content, buffer_) ) {
+    *result = 0;
+    return 0;
+  }
+  if (measure_->metric == 'w') {
+    return get_weighted_result(measure_->costs_, measure_->option,
+                               &profile_->content, buffer_, result);
+  }
+  switch (measure_->option) {
+  case 'd':
+    STATS_START(timer);
+    ret = get_distance_masked(measure_->metric,
+                              profile_->masks.words,
+                              profile_->masks.stride,
+                              profile_->masks.rows,
+                              profile_->masks.size,
+                              buffer_->pointer, buffer_->size,
+                              result);
+    if (!ret) {
+      STATS_STOP(timer, STATS_DP);
+      STATS_COUNT(STATS_CELLS, (double)profile_->masks.size * buffer_->size);
+    }
+    return ret;
+  case 'l':
+    get_histogram(buffer_, histogram);
+    if (measure_->metric != 'i') {
+      get_sketch(buffer_, sketch);
+    }
+    return get_lb_from_summaries(measure_,
+                                 profile_->histogram, profile_->sketch,
+                                 profile_->content.size,
+                                 histogram, sketch, buffer_->size,
+                                 result);
+  case 'u':
+    return get_ub_masked(measure_->metric, &profile_->content, &profile_->masks,
+                         buffer_, result);
+  }
+  return 1;
+}
+
+
+
+/*  Caching results
+
+    A cache file stores results of previous computations. Each result is keyed
+    by the hashes of both buffers and by the mode of the computation. The file
+    is an open-addressing hash table with linear probing:
+      - a header (cache_header) and
+      - a power-of-two number of slots (cache_slot) follow each other,
+    both in native byte order and without padding. The file is mapped shared
+    (see mapping_create_shared); a lookup reads the slots in place, and an
+    insert writes one slot. A slot is in use if and only if its check value
+    matches its content; this way, torn writes of concurrent processes only
+    cause cache misses.
+
+    A new file is written at once, with all slots zeroed. If the probes of a
+    key find no free slot, the table is doubled: the slots in use are
+    rehashed into a new file, which replaces the old one by a rename.
+    Processes that still map the old file only miss the later results.
+*/
+
+#define CACHE_MAGIC UINT64_C(0x3165686361636c62) /* "blcache1" */
+#define CACHE_SLOT_COUNT 65536
+#define CACHE_MAX_PROBES 16
+
+typedef struct {
+  uint64_t magic;
+  uint64_t slot_size;
+  uint64_t slot_count;
+} cache_header;
+
+typedef struct {
+  uint64_t hash_1[2];
+  uint64_t hash_2[2];
+  uint64_t mode;
+  uint64_t value;
+  uint64_t check;
+} cache_slot;
+
+typedef struct {
+  char * file_path;
+  mapping * mapping_; /* the header and the slots */
+  uint64_t slot_count;
+#ifndef NO_THREADS
+  pthread_mutex_t mutex;
+#endif
+} cache;
+
+uint64_t cache_slot_check(cache_slot const * const slot) {
+  uint64_t check = UINT64_C(0x9e3779b97f4a7c15);
+  check = uint64_fmix(check ^ slot->hash_1[0]);
+  check = uint64_fmix(check ^ slot->hash_1[1]);
+  check = uint64_fmix(check ^ slot->hash_2[0]);
+  check = uint64_fmix(check ^ slot->hash_2[1]);
+  check = uint64_fmix(check ^ slot->mode);
+  check = uint64_fmix(check ^ slot->value);
+  return check | 1; /* A zeroed slot is never in use. */
+}
+
+uint64_t cache_home(uint64_t const slot_count,
+                    cache_slot const * const key) {
+  return uint64_fmix( key->hash_1[0] ^
+                      uint64_rotl(key->hash_2[0], 17) ^
+                      key->mode ) & (slot_count - 1);
+}
+
+void cache_read_slot(cache const * const cache_,
+                     uint64_t const index,
+                     cache_slot * const slot) {
+  memcpy( slot, cache_->mapping_->pointer + sizeof(cache_header) +
+                index * sizeof(*slot), sizeof(*slot) );
+}
+
+int cache_write_slot(cache * const cache_,
+                     uint64_t const index,
+                     cache_slot const * const slot) {
+  return mapping_write(cache_->mapping_,
+                       sizeof(cache_header) + index * sizeof(*slot),
+                       slot, sizeof(*slot));
+}
+
+/*  cache_write_table writes a table of slot_count slots to the file, with the
+    slots in use of the old cache, if any, rehashed into it. The file is
+    written under a temporary name, which then replaces the file_path.
+*/
+
+int cache_write_table(char const * const file_path,
+                      uint64_t const slot_count,
+                      cache const * const old) {
+  cache_header * header = NULL;
+  cache_slot * slots = NULL;
+  cache_slot slot = {0};
+  char * temporary_path = NULL;
+  size_t const path_size = strlen(file_path);
+  size_t size = 0;
+  FILE * file = NULL;
+  uint64_t home = 0;
+  uint64_t i = 0;
+  uint64_t j = 0;
+  int ret = 0;
+
+  if ( slot_count > (SIZE_MAX - sizeof(*header)) / sizeof(*slots) ||
+       path_size > SIZE_MAX - 5 ) {
+    return 1;
+  }
+  size = sizeof(*header) + (size_t)slot_count * sizeof(*slots);
+  header = stats_calloc(1, size);
+  temporary_path = stats_malloc(path_size + 5);
+  if (!header || !temporary_path) {
+    free(temporary_path);
+    free(header);
+    return 1;
+  }
+  header->magic = CACHE_MAGIC;
+  header->slot_size = sizeof(*slots);
+  header->slot_count = slot_count;
+  slots = (cache_slot *)(header + 1);
+  for (i = 0; old && i < old->slot_count; ++i) {
+    cache_read_slot(old, i, &slot);
+    if ( slot.check != cache_slot_check(&slot) ) {
+      continue;
+    }
+    home = cache_home(slot_count, &slot);
+    for (j = 0; j < CACHE_MAX_PROBES && j < slot_count; ++j) {
+      if (!slots[(home + j) & (slot_count - 1)].check) {
+        slots[(home + j) & (slot_count - 1)] = slot;
+        break;
+      }
+    }
+  }
+  memcpy(temporary_path, file_path, path_size);
+  memcpy(temporary_path + path_size, ".new", 5);
+  file = fopen(temporary_path, "wb");
+  ret = !file || size != fwrite(header, 1, size, file);
+  if (file && fclose(file)) {
+    ret = 1;
+  }
+  if (!ret) {
+    ret = rename(temporary_path, file_path) != 0;
+  }
+  if (ret) {
+    remove(temporary_path);
+  }
+  free(temporary_path);
+  free(header);
+  return ret;
+}
+
+/*  cache_map maps the file, which must hold a valid table. */
+
+int cache_map(cache * const cache_) {
+  cache_header header = {0};
+  mapping * map = NULL;
+
+  if ( mapping_create_shared(cache_->file_path, &map) ) {
+    return 1;
+  }
+  if (map->size >= sizeof(header)) {
+    memcpy( &header, map->pointer, sizeof(header) );
+  }
+  if ( header.magic != CACHE_MAGIC ||
+       header.slot_size != sizeof(cache_slot) ||
+       header.slot_count == 0 ||
+       header.slot_count & (header.slot_count - 1) ||
+       header.slot_count > (SIZE_MAX - sizeof(header)) / sizeof(cache_slot) ||
+       map->size != sizeof(header) + (size_t)header.slot_count * sizeof(cache_slot) ) {
+    mapping_destroy(map);
+    return 1;
+  }
+  mapping_destroy(cache_->mapping_);
+  cache_->mapping_ = map;
+  cache_->slot_count = header.slot_count;
+  return 0;
+}
+
+void cache_destroy(cache * const cache_) {
+  if (cache_) {
+    if (cache_->mapping_) {
+      mapping_destroy(cache_->mapping_);
+#ifndef NO_THREADS
+      pthread_mutex_destroy(&cache_->mutex);
+#endif
+    }
+    free(cache_->file_path);
+  }
+  free(cache_);
+}
+
+int cache_create(char const * const file_path,
+                 cache ** const cache_) {
+  cache * cach = NULL;
+  FILE * file = NULL;
+
+  cach = stats_calloc( 1, sizeof(*cach) );
+  if (!cach) {
+    return 1;
+  }
+  cach->file_path = string_copy(file_path);
+  if (!cach->file_path) {
+    free(cach);
+    return 1;
+  }
+
+  file = fopen(file_path, "rb");
+  if (file) {
+    fclose(file);
+  }
+  else if ( cache_write_table(file_path, CACHE_SLOT_COUNT, NULL) ) {
+    free(cach->file_path);
+    free(cach);
+    return 1;
+  }
+  if ( cache_map(cach) ) {
+    free(cach->file_path);
+    free(cach);
+    return 1;
+  }
+#ifndef NO_THREADS
+  if ( pthread_mutex_init(&cach->mutex, NULL) ) {
+    mapping_destroy(cach->mapping_);
+    free(cach->file_path);
+    free(cach);
+    return 1;
+  }
+#endif
+
+  *cache_ = cach;
+  return 0;
+}
+
+int cache_key_matches(cache_slot const * const slot,
+                      cache_slot const * const key) {
+  return slot->check == cache_slot_check(slot) &&
+         slot->hash_1[0] == key->hash_1[0] &&
+         slot->hash_1[1] == key->hash_1[1] &&
+         slot->hash_2[0] == key->hash_2[0] &&
+         slot->hash_2[1] == key->hash_2[1] &&
+         slot->mode == key->mode;
+}
+
+void cache_key(buffer const * const buffer_1,
+               buffer const * const buffer_2,
+               uint64_t const mode,
+               cache_slot * const key) {
+  key->hash_1[0] = buffer_1->hash[0];
+  key->hash_1[1] = buffer_1->hash[1];
+  key->hash_2[0] = buffer_2->hash[0];
+  key->hash_2[1] = buffer_2->hash[1];
+  key->mode = mode;
+  key->value = 0;
+  key->check = 0;
+}
+
+int cache_find_unlocked(cache * const cache_,
+               buffer const * const buffer_1,
+               buffer const * const buffer_2,
+               uint64_t const mode,
+               size_t * const value) {
+  cache_slot key = {0};
+  cache_slot slot = {0};
+  uint64_t home = 0;
+  uint64_t i = 0;
+
+  cache_key(buffer_1, buffer_2, mode, &key);
+  home = cache_home(cache_->slot_count, &key);
+  for (i = 0; i < CACHE_MAX_PROBES && i < cache_->slot_count; ++i) {
+    cache_read_slot(cache_, (home + i) & (cache_->slot_count - 1), &slot);
+    if (slot.check == 0) {
+      return 1;
+    }
+    if ( cache_key_matches(&slot, &key) ) {
+      if (slot.value > SIZE_MAX) {
+        return 1;
+      }
+      *value = (size_t)slot.value;
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/*  If all probed slots are in use, cache_insert_unlocked doubles the table
+    and tries again.
+*/
+
+int cache_insert_unlocked(cache * const cache_,
+                 buffer const * const buffer_1,
+                 buffer const * const buffer_2,
+                 uint64_t const mode,
+                 size_t const value) {
+  cache_slot key = {0};
+  cache_slot slot = {0};
+  uint64_t home = 0;
+  uint64_t i = 0;
+  uint64_t index = 0;
+
+  cache_key(buffer_1, buffer_2, mode, &key);
+  key.value = value;
+  key.check = cache_slot_check(&key);
+  for (;;) {
+    home = cache_home(cache_->slot_count, &key);
+    for (i = 0; i < CACHE_MAX_PROBES && i < cache_->slot_count; ++i) {
+      index = (home + i) & (cache_->slot_count - 1);
+      cache_read_slot(cache_, index, &slot);
+      if ( slot.check != cache_slot_check(&slot) ||
+           cache_key_matches(&slot, &key) ) {
+        return cache_write_slot(cache_, index, &key);
+      }
+    }
+    if ( cache_write_table(cache_->file_path, 2 * cache_->slot_count, cache_) ||
+         cache_map(cache_) ) {
+      return 1;
+    }
+  }
+}
+
+/*  cache_find succeeds (returns 0) if and only if the cache holds a value for
+    the given key. Both cache_find and cache_insert may be called from any
+    thread.
+*/
+
+int cache_find(cache * const cache_,
+               buffer const * const buffer_1,
+               buffer const * const buffer_2,
+               uint64_t const mode,
+               size_t * const value) {
+  int ret = 0;
+#ifndef NO_THREADS
+  pthread_mutex_lock(&cache_->mutex);
+#endif
+  ret = cache_find_unlocked(cache_, buffer_1, buffer_2, mode, value);
+#ifndef NO_THREADS
+  pthread_mutex_unlock(&cache_->mutex);
+#endif
+  return ret;
+}
+
+int cache_insert(cache * const cache_,
+                 buffer const * const buffer_1,
+                 buffer const * const buffer_2,
+                 uint64_t const mode,
+                 size_t const value) {
+  int ret = 0;
+#ifndef NO_THREADS
+  pthread_mutex_lock(&cache_->mutex);
+#endif
+  ret = cache_insert_unlocked(cache_, buffer_1, buffer_2, mode, value);
+#ifndef NO_THREADS
+  pthread_mutex_unlock(&cache_->mutex);
+#endif
+  return ret;
+}
+
+
+
+/*  Computing a result
+
+    The measure selects the computation. Identical buffers are collapsed,
+    since their distance and both bounds are 0.
+*/
+
+/*  get_memory_needed estimates the least memory that the computation of the
+    measure allocates besides both buffers. The bounds take little memory: the
+    upper bounds compare chunks of 1024 bytes. The option 'a' (all results)
+    needs the memory of the distance.
+*/
+
+int get_memory_needed(measure const * const measure_,
+                      buffer const * const buffer_1,
+                      buffer const * const buffer_2,
+                      double * const memory) {
+  plan plan_;
+  int ret = 0;
+
+  *memory = 0;
+  switch (measure_->option) {
+  case 'a':
+  case 'd':
+    if (measure_->metric == 'w' && !measure_->costs_->unit) {
+      /* the diagonals and the costs of get_weighted_distance */
+      *memory = sizeof(uint32_t) * ( 5 * ((double)buffer_1->size + 1) +
+                                     2 * (double)buffer_2->size );
+      return 0;
+    }
+    ret = get_plan(measure_->metric == 'w' ? 'l' : measure_->metric,
+                   measure_->calibration_, measure_->max_memory,
+                   buffer_1, buffer_2, NULL, SIZE_MAX, &plan_);
+    if (ret) {
+      return ret;
+    }
+    switch (plan_.engine) {
+    case 'b':
+      *memory = plan_.bit_parallel_memory;
+      break;
+    case 'g':
+      *memory = plan_.diagonal_memory;
+      break;
+    case 'n':
+      *memory = plan_.bit_parallel_memory;
+      if (measure_->metric == 'l' && plan_.diagonal_memory < *memory) {
+        *memory = plan_.diagonal_memory;
+      }
+      break;
+    }
+    return 0;
+  case 'u':
+    *memory = sizeof(uint64_t) * (256 + 1 + 4) * get_word_count(1024);
+    return 0;
+  }
+  return 0;
+}
+
+/*  get_stage_name names the computation of the option, for traces. */
+
+char const * get_stage_name(char const option) {
+  switch (option) {
+  case 'd':
+    return "distance";
+  case 'l':
+    return "lower_bound";
+  }
+  return "upper_bound";
+}
+
+int get_result(measure const * const measure_,
+               buffer const * const buffer_1,
+               buffer const * const buffer_2,
+               size_t * const result) {
+  int ret = 1;
+  TRACE_TIMER(begin)
+
+  if ( buffer_identical(buffer_1, buffer_2) ) {
+    *result = 0;
+    return 0;
+  }
+  TRACE_START(begin);
+  if (measure_->metric == 'w') {
+    ret = get_weighted_result(measure_->costs_, measure_->option,
+                              buffer_1, buffer_2, result);
+  }
+  else {
+    switch (measure_->option) {
+    case 'd':
+#ifdef SCALAR_LEVENSHTEIN
+      if (measure_->metric == 'l') {
+        ret = get_levenshtein_distance(buffer_1, buffer_2, result);
+        break;
+      }
+#endif
+      ret = get_planned_distance(measure_->metric, measure_->calibration_,
+                                 measure_->max_memory, buffer_1, buffer_2,
+                                 SIZE_MAX, NULL, result);
+      break;
+    case 'l':
+      if (measure_->metric == 'i') {
+        ret = get_indel_lb(buffer_1, buffer_2, result);
+      }
+      else {
+        ret = get_ld_lb(measure_->metric, buffer_1, buffer_2, result);
+      }
+      break;
+    case 'u':
+      ret = get_ub_masked(measure_->metric, buffer_1, NULL, buffer_2, result);
+      break;
+    }
+  }
+  TRACE_STOP(begin, get_stage_name(measure_->option), "stage");
+  return ret;
+}
+
+/*  get_cached_result consults the cache, if any, before it computes a result;
+    then, it adds the result to the cache.
+*/
+
+int get_cached_result(cache * const cache_,
+                      measure const * const measure_,
+                      buffer const * const buffer_1,
+                      buffer const * const buffer_2,
+                      size_t * const result) {
+  int ret = 0;
+
+  if ( cache_ &&
+       !cache_find(cache_, buffer_1, buffer_2, measure_key(measure_), result) ) {
+    return 0;
+  }
+  ret = get_result(measure_, buffer_1, buffer_2, result);
+  if (ret) {
+    return ret;
+  }
+  if (cache_) {
+    if ( cache_insert(cache_, buffer_1, buffer_2, measure_key(measure_), *result) ) {
+      fprintf(stderr, "Warning: Could not update cache.\n");
+    }
+  }
+  return 0;
+}
+
+
+
+/*  Batch execution
+
+    A batch computes the results for all pairs of files in a file list. Its
+    output consists of a header line ("bytelev-batch" followed by the number
+    of files) and one line "i j result" per pair of file indices i < j.
+
+    A batch can be split into shards. Shard k of N computes those pairs whose
+    estimated cost falls into the k-th of N equal parts of the total estimated
+    cost, with the pairs taken in the order of the output. The estimates only
+    depend on the file sizes; thus, each shard can be computed independently,
+    by any process on any machine, and the shards are disjoint and complete.
+*/
+
+typedef struct {
+  size_t index;
+  size_t count;
+} shard;
+
+int shard_from_string(shard * const res, char const * const string) {
+  char part[32] = {0};
+  char const * slash = NULL;
+  shard shard_ = {0};
+  int ret = 0;
+
+  slash = strchr(string, '/');
+  if ( !slash ||
+       (size_t)(slash - string) >= sizeof(part) ) {
+    return 1;
+  }
+  memcpy(part, string, slash - string);
+  ret = size_t_from_string(&shard_.index, part);
+  if (ret) {
+    return ret;
+  }
+  ret = size_t_from_string(&shard_.count, slash + 1);
+  if (ret) {
+    return ret;
+  }
+  if (shard_.index >= shard_.count) {
+    return 1;
+  }
+
+  *res = shard_;
+  return 0;
+}
+
+/*  Pairs are numbered in the order of the output. */
+
+size_t get_pair_index(size_t const count,
+                      size_t const i,
+                      size_t const j) {
+  assert(i < j && j < count);
+  return i * count - i * (i + 1) / 2 + (j - i - 1);
+}
+
+/*  The estimated cost of a pair is proportional to the number of steps of
+    the respective computation.
+*/
+
+double get_cost_estimate(char const option,
+                         size_t const size_1,
+                         size_t const size_2) {
+  double const size_min = (double)minimum(size_1, size_2);
+  double const size_sum = (double)size_1 + (double)size_2;
+
+  switch (option) {
+  case 'd':
+    return size_sum + (double)size_1 * (double)size_2;
+  case 'u':
+    return size_sum + (size_sum - size_min) * minimum(size_min, 1024);
+  }
+  return size_sum + 1;
+}
+
+/*  Tiled scheduling
+
+    With a memory budget, a batch first reserves the working memory of the
+    computations that run in parallel. For the bounds, get_memory_needed gives
+    it without the contents. For the distance, half of the budget is reserved
+    and split into one share per thread: there are only as many threads as
+    shares that afford the bit-parallel engine for the largest pair, whatever
+    its alphabet (but at least one). Each computation plans within its share
+    (see get_plan) and fails before it starts if get_memory_needed exceeds it.
+    Then, the batch partitions the file list into tiles of consecutive files;
+    each tile fits into a third of the rest of the budget. The batch processes
+    pairs of tiles in block nested-loop order: the first tile of a pair stays
+    resident while the second one sweeps across the remaining tiles, forth and
+    back in alternating rows, so that the last tile of a row is reused in the
+    next row. Up to three tiles are resident: the two tiles of the current pair
+    and the tile that is prefetched for the next pair while the current one is
+    computed. Without a budget, all files form a single tile.
+*/
+
+typedef struct {
+  file_list const * list;
+  unsigned char const * needed;
+  size_t max_size;
+  size_t tile;
+  size_t first;
+  size_t end;
+  buffer ** buffers; /* indices: 0, ..., end - first - 1 */
+  int ret;
+} tile_load;
+
+void * tile_load_run(void * const tile_load_) {
+  tile_load * const load = tile_load_;
+  size_t i = 0;
+  TRACE_TIMER(begin)
+
+  TRACE_START(begin);
+  load->ret = 0;
+  for (i = load->first; i < load->end; ++i) {
+    if (load->needed[i]) {
+      load->ret = buffer_create(load->list->paths[i], load->max_size,
+                                &load->buffers[i - load->first]);
+      if (load->ret) {
+        fprintf(stderr, "Error: Could not read file %s.\n", load->list->paths[i]);
+        break;
+      }
+    }
+  }
+  TRACE_STOP(begin, "tile", "load");
+  return NULL;
+}
+
+void tile_load_release(tile_load * const load) {
+  size_t i = 0;
+  for (i = load->first; i < load->end; ++i) {
+    buffer_destroy(load->buffers[i - load->first]);
+    load->buffers[i - load->first] = NULL;
+  }
+  load->tile = SIZE_MAX;
+  load->first = 0;
+  load->end = 0;
+}
+
+buffer * tile_load_get(tile_load const * const loads,
+                       size_t const index) {
+  size_t s = 0;
+  for (s = 0; s < 3; ++s) {
+    if (index >= loads[s].first && index < loads[s].end) {
+      return loads[s].buffers[index - loads[s].first];
+    }
+  }
+  return NULL;
+}
+
+/*  The pairs of a pair of tiles are computed in blocks of up to
+    BATCH_BLOCK_SIZE pairs; the pairs of a block are computed in parallel,
+    then their results are printed in order.
+*/
+
+#define BATCH_BLOCK_SIZE 4096
+
+typedef struct {
+  measure const * measure_; /* its max_memory is the share of a computation */
+  file_list const * list;
+  cache * cache_;
+  tile_load const * loads;
+  size_t * pairs; /* indices: 2 * k, 2 * k + 1 for the k-th pair of the block */
+  size_t * results;
+} batch_block;
+
+int batch_block_compute(void * const block_, size_t const index) {
+  batch_block const * const block = block_;
+  size_t const i = block->pairs[2 * index];
+  size_t const j = block->pairs[2 * index + 1];
+  buffer const * const buffer_1 = tile_load_get(block->loads, i);
+  buffer const * const buffer_2 = tile_load_get(block->loads, j);
+  double memory = 0;
+
+  assert(buffer_1 && buffer_2);
+  if (block->measure_->max_memory) {
+    if ( get_memory_needed(block->measure_, buffer_1, buffer_2, &memory) ) {
+      return 1;
+    }
+    if ( memory > (double)block->measure_->max_memory ) {
+      fprintf(stderr, "Error: The computation for %s and %s needs about %.0f bytes "
+              "of memory, more than its share of the budget.\n",
+              block->list->paths[i], block->list->paths[j], memory);
+      return 1;
+    }
+  }
+  return get_cached_result(block->cache_, block->measure_, buffer_1, buffer_2,
+                           &block->results[index]);
+}
+
+int batch_block_run(batch_block const * const block,
+                    size_t const count,
+                    size_t const thread_count) {
+  size_t k = 0;
+
+  if ( parallel_for(count, thread_count, batch_block_compute, (void *)block) ) {
+    fprintf(stderr, "Error: Computation failed.\n");
+    return 1;
+  }
+  for (k = 0; k < count; ++k) {
+    if ( printf("%" SIZE_T_FORMAT " %" SIZE_T_FORMAT " %" SIZE_T_FORMAT "\n",
+                block->pairs[2 * k], block->pairs[2 * k + 1], block->results[k]) < 0 ) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int batch_run(measure const * const measure_,
+              char const * const list_path,
+              shard const * const shard_,
+              size_t const max_size,
+              size_t const max_memory,
+              size_t const thread_count,
+              cache * const cache_) {
+  int ret = 0;
+  file_list * list = NULL;
+  measure share_measure = *measure_;
+  buffer empty = {0};
+  batch_block block = {0};
+  size_t * sizes = NULL;
+  unsigned char * needed = NULL;
+  size_t * tile_firsts = NULL;
+  size_t * steps = NULL;
+  tile_load loads[3];
+  thread prefetch = {0};
+  tile_load * prefetching = NULL;
+  double total = 0;
+  double done = 0;
+  double cost = 0;
+  size_t pair_begin = SIZE_MAX;
+  size_t pair_end = 0;
+  size_t pair = 0;
+  size_t size_max = 0;
+  size_t capacity = SIZE_MAX;
+  size_t workers = thread_count;
+  size_t reserve = 0;
+  double memory = 0;
+  size_t tile_count = 0;
+  size_t tile_length = 0;
+  size_t step_count = 0;
+  size_t block_count = 0;
+  size_t a = 0;
+  size_t b = 0;
+  size_t s = 0;
+  size_t t = 0;
+  size_t i = 0;
+  size_t j = 0;
+  size_t k = 0;
+  TRACE_TIMER(begin)
+
+  memset( loads, 0, sizeof(loads) );
+
+  ret = file_list_create(list_path, &list);
+  if (ret) {
+    fprintf(stderr, "Error: Could not read list file.\n");
+    return ret;
+  }
+  sizes = stats_calloc( list->count + 1, sizeof(*sizes) );
+  needed = stats_calloc(1, list->count + 1);
+  tile_firsts = stats_calloc( list->count + 2, sizeof(*tile_firsts) );
+  if (!sizes || !needed || !tile_firsts) {
+    ret = 1;
+    goto end;
+  }
+
+  for (i = 0; i < list->count; ++i) {
+    ret = get_file_size(list->paths[i], &sizes[i]);
+    if (ret) {
+      fprintf(stderr, "Error: Could not read file %s.\n", list->paths[i]);
+      goto end;
+    }
+    sizes[i] = minimum(sizes[i], max_size);
+    if (size_max < sizes[i]) {
+      size_max = sizes[i];
+    }
+  }
+
+  /* The pairs of the shard form a range of consecutive pairs. */
+  for (i = 0; i < list->count; ++i) {
+    for (j = i + 1; j < list->count; ++j) {
+      total += get_cost_estimate(measure_->option, sizes[i], sizes[j]);
+    }
+  }
+  for (i = 0; i < list->count; ++i) {
+    for (j = i + 1; j < list->count; ++j, ++pair) {
+      cost = get_cost_estimate(measure_->option, sizes[i], sizes[j]);
+      k = shard_->index;
+      if (total > 0) {
+        double const part = (done + cost / 2) * shard_->count / total;
+        k = minimum( (size_t)part, shard_->count - 1 );
+      }
+      done += cost;
+      if (k == shard_->index) {
+        if (pair_begin == SIZE_MAX) {
+          pair_begin = pair;
+        }
+        pair_end = pair + 1;
+        needed[i] = 1;
+        needed[j] = 1;
+      }
+    }
+  }
+
+  /* Reserve the working memory, then partition the files into tiles. */
+  if (pair_end) {
+    workers = minimum(workers, pair_end - pair_begin);
+  }
+  workers = maximum(workers, 1);
+  if (max_memory) {
+    if (measure_->option == 'd') {
+      /* the bit-parallel engine for the largest pair and 256 symbols */
+      memory = (double)sizeof(uint64_t) * (double)get_word_count(size_max) *
+               (256 + 1 + 4);
+    }
+    else {
+      ret = get_memory_needed(measure_, &empty, &empty, &memory);
+      if (ret) {
+        goto end;
+      }
+    }
+    if (memory > 0) {
+      workers = minimum( workers,
+                         maximum((size_t)((double)(max_memory / 2) / memory), 1) );
+    }
+    if (measure_->option == 'd') {
+      reserve = max_memory / 2 / workers * workers;
+    }
+    else {
+      reserve = memory < (double)max_memory ? (size_t)memory * workers : SIZE_MAX;
+    }
+    if ( reserve > max_memory ||
+         (measure_->option == 'd' && !reserve) ) {
+      fprintf(stderr, "Error: The memory budget does not cover the working memory.\n");
+      ret = 1;
+      goto end;
+    }
+    share_measure.max_memory = reserve / workers;
+    capacity = (max_memory - reserve) / 3;
+  }
+  tile_firsts[0] = 0;
+  for (i = 0, t = 0; i < list->count; ++i) {
+    if (!needed[i]) {
+      continue;
+    }
+    if (sizes[i] > capacity) {
+      fprintf(stderr, "Error: The memory budget is too small for file %s.\n", list->paths[i]);
+      ret = 1;
+      goto end;
+    }
+    if (capacity - t < sizes[i]) {
+      tile_firsts[++tile_count] = i;
+      t = 0;
+    }
+    t += sizes[i];
+  }
+  tile_firsts[++tile_count] = list->count;
+  for (a = 0; a < tile_count; ++a) {
+    if (tile_length < tile_firsts[a + 1] - tile_firsts[a]) {
+      tile_length = tile_firsts[a + 1] - tile_firsts[a];
+    }
+  }
+
+  /* Order the pairs of tiles; skip those without pairs of the shard. */
+  steps = stats_calloc( tile_count * (tile_count + 1) + 1, sizeof(*steps) );
+  if (!steps) {
+    ret = 1;
+    goto end;
+  }
+  for (a = 0; a < tile_count; ++a) {
+    for (t = a; t < tile_count; ++t) {
+      b = a % 2 ? tile_count - 1 - (t - a) : t;
+      for (i = tile_firsts[a]; i < tile_firsts[a + 1]; ++i) {
+        j = maximum(i + 1, tile_firsts[b]);
+        if ( j < tile_firsts[b + 1] &&
+             get_pair_index(list->count, i, j) < pair_end &&
+             get_pair_index(list->count, i, tile_firsts[b + 1] - 1) >= pair_begin ) {
+          steps[2 * step_count] = a;
+          steps[2 * step_count + 1] = b;
+          ++step_count;
+          break;
+        }
+      }
+    }
+  }
+
+  block.measure_ = &share_measure;
+  block.list = list;
+  block.cache_ = cache_;
+  block.loads = loads;
+  block.pairs = stats_calloc( 2 * BATCH_BLOCK_SIZE, sizeof(*block.pairs) );
+  block.results = stats_calloc( BATCH_BLOCK_SIZE, sizeof(*block.results) );
+  if (!block.pairs || !block.results) {
+    ret = 1;
+    goto end;
+  }
+  for (s = 0; s < 3; ++s) {
+    loads[s].list = list;
+    loads[s].needed = needed;
+    loads[s].max_size = max_size;
+    loads[s].tile = SIZE_MAX;
+    loads[s].buffers = stats_calloc( tile_length + 1, sizeof(*loads[s].buffers) );
+    if (!loads[s].buffers) {
+      ret = 1;
+      goto end;
+    }
+  }
+
+  if ( printf("bytelev-batch %" SIZE_T_FORMAT "\n", list->count) < 0 ) {
+    ret = 1;
+    goto end;
+  }
+  for (pair = 0; pair < step_count; ++pair) {
+    a = steps[2 * pair];
+    b = steps[2 * pair + 1];
+
+    if (prefetching) {
+      TRACE_START(begin);
+      thread_join(&prefetch);
+      TRACE_STOP(begin, "prefetch", "queue");
+      ret = prefetching->ret;
+      prefetching = NULL;
+      if (ret) {
+        goto end;
+      }
+    }
+
+    /* Load the tiles of the current pair, then prefetch the next one. */
+    for (k = 0; k < 4; ++k) {
+      t = k % 2 ? b : a;
+      if (k >= 2) {
+        if (pair + 1 == step_count) {
+          break;
+        }
+        t = steps[2 * (pair + 1) + k % 2];
+      }
+      for (s = 0; s < 3 && loads[s].tile != t; ++s) {
+      }
+      if (s < 3) {
+        continue;
+      }
+      for (s = 0; loads[s].tile == a || loads[s].tile == b; ++s) {
+      }
+      tile_load_release(&loads[s]);
+      loads[s].tile = t;
+      loads[s].first = tile_firsts[t];
+      loads[s].end = tile_firsts[t + 1];
+      if (k < 2) {
+        tile_load_run(&loads[s]);
+        ret = loads[s].ret;
+        if (ret) {
+          goto end;
+        }
+      }
+      else {
+        ret = thread_start(&prefetch, tile_load_run, &loads[s]);
+        if (ret) {
+          goto end;
+        }
+        prefetching = &loads[s];
+        break;
+      }
+    }
+
+    for (i = tile_firsts[a]; i < tile_firsts[a + 1]; ++i) {
+      for (j = maximum(i + 1, tile_firsts[b]); j < tile_firsts[b + 1]; ++j) {
+        k = get_pair_index(list->count, i, j);
+        if (k < pair_begin || k >= pair_end) {
+          continue;
+        }
+        block.pairs[2 * block_count] = i;
+        block.pairs[2 * block_count + 1] = j;
+        if (++block_count == BATCH_BLOCK_SIZE) {
+          ret = batch_block_run(&block, block_count, workers);
+          if (ret) {
+            goto end;
+          }
+          block_count = 0;
+        }
+      }
+    }
+    ret = batch_block_run(&block, block_count, workers);
+    if (ret) {
+      goto end;
+    }
+    block_count = 0;
+  }
+
+end:
+  if (prefetching) {
+    thread_join(&prefetch);
+  }
+  for (s = 0; s < 3; ++s) {
+    if (loads[s].buffers) {
+      tile_load_release(&loads[s]);
+    }
+    free(loads[s].buffers);
+  }
+  free(block.results);
+  free(block.pairs);
+  free(steps);
+  free(tile_firsts);
+  free(needed);
+  free(sizes);
+  file_list_destroy(list);
+  return ret;
+}
+
+
+
+/*  Merging batch outputs
+
+    Merging reads the outputs of all shards of a batch; it checks that each
+    pair occurs exactly once, and prints either the complete batch output,
+    sorted by pair, or the symmetric matrix of results.
+*/
+
+int read_line(FILE * const file,
+              char * const line,
+              size_t const line_size) {
+  size_t length = 0;
+
+  if ( !fgets(line, (int)line_size, file) ) {
+    return 1;
+  }
+  length = strlen(line);
+  if (length == line_size - 1 &&
+      line[length - 1] != '\n') {
+    return 1;
+  }
+  while ( length &&
+          (line[length - 1] == '\n' ||
+           line[length - 1] == '\r') ) {
+    line[--length] = '\0';
+  }
+  return 0;
+}
+
+int merge_run(char const format,
+              int const file_count,
+              char * file_paths[]) {
+  int ret = 0;
+  int f = 0;
+  FILE * file = NULL;
+  char line[128] = {0};
+  char * fields[3] = {0};
+  size_t values[3] = {0};
+  size_t count = 0;
+  size_t file_count_ = 0;
+  size_t pair_count = 0;
+  size_t * results = NULL;
+  unsigned char * seen = NULL;
+  size_t i = 0;
+  size_t j = 0;
+  size_t p = 0;
+
+  for (f = 0; !ret && f < file_count; ++f) {
+    file = fopen(file_paths[f], "rb");
+    if (!file) {
+      fprintf(stderr, "Error: Could not read %s.\n", file_paths[f]);
+      ret = 1;
+      break;
+    }
+    if ( read_line(file, line, sizeof(line)) ||
+         strncmp(line, "bytelev-batch ", 14) ||
+         size_t_from_string(&file_count_, line + 14) ||
+         results && file_count_ != count ) {
+      fprintf(stderr, "Error: %s is not the output of this batch.\n", file_paths[f]);
+      fclose(file);
+      ret = 1;
+      break;
+    }
+    if (!results) {
+      count = file_count_;
+      pair_count = count ? count * (count - 1) / 2 : 0;
+      if ( count && (count - 1 > SIZE_MAX / count ||
+                     pair_count > SIZE_MAX / sizeof(*results)) ) {
+        fclose(file);
+        ret = 1;
+        break;
+      }
+      results = stats_calloc( pair_count + 1, sizeof(*results) );
+      seen = stats_calloc(1, pair_count + 1);
+      if (!results || !seen) {
+        fclose(file);
+        ret = 1;
+        break;
+      }
+    }
+
+    while ( !read_line(file, line, sizeof(line)) ) {
+      fields[0] = strtok(line, " ");
+      fields[1] = strtok(NULL, " ");
+      fields[2] = strtok(NULL, " ");
+      if ( !fields[0] || !fields[1] || !fields[2] || strtok(NULL, " ") ||
+           size_t_from_string(&values[0], fields[0]) ||
+           size_t_from_string(&values[1], fields[1]) ||
+           size_t_from_string(&values[2], fields[2]) ||
+           values[0] >= values[1] ||
+           values[1] >= count ) {
+        fprintf(stderr, "Error: Malformed line in %s.\n", file_paths[f]);
+        ret = 1;
+        break;
+      }
+      p = get_pair_index(count, values[0], values[1]);
+      if (seen[p]) {
+        fprintf(stderr, "Error: Pair %" SIZE_T_FORMAT " %" SIZE_T_FORMAT " occurs more than once.\n",
+                values[0], values[1]);
+        ret = 1;
+        break;
+      }
+      seen[p] = 1;
+      results[p] = values[2];
+    }
+    if (!ret && !feof(file)) {
+      fprintf(stderr, "Error: Could not read %s.\n", file_paths[f]);
+      ret = 1;
+    }
+    fclose(file);
+  }
+
+  for (p = 0; !ret && p < pair_count; ++p) {
+    if (!seen[p]) {
+      fprintf(stderr, "Error: Some pairs are missing; merge the outputs of all shards.\n");
+      ret = 1;
+    }
+  }
+
+  if (!ret && format == 'p') {
+    ret = printf("bytelev-batch %" SIZE_T_FORMAT "\n", count) < 0;
+    for (i = 0; !ret && i < count; ++i) {
+      for (j = i + 1; !ret && j < count; ++j) {
+        ret = printf("%" SIZE_T_FORMAT " %" SIZE_T_FORMAT " %" SIZE_T_FORMAT "\n",
+                     i, j, results[get_pair_index(count, i, j)]) < 0;
+      }
+    }
+  }
+  if (!ret && format == 'm') {
+    for (i = 0; !ret && i < count; ++i) {
+      for (j = 0; !ret && j < count; ++j) {
+        if (i < j) {
+          p = results[get_pair_index(count, i, j)];
+        }
+        else if (j < i) {
+          p = results[get_pair_index(count, j, i)];
+        }
+        else {
+          p = 0;
+        }
+        ret = printf("%s%" SIZE_T_FORMAT, j ? " " : "", p) < 0;
+      }
+      if (!ret) {
+        ret = printf("\n") < 0;
+      }
+    }
+  }
+
+  free(seen);
+  free(results);
+  return ret;
+}
+
+
+
+/*  struct corpus
+
+    A corpus keeps the files of a file list resident, together with their
+    byte histograms and sketches, so that its lower bounds equal those of
+    get_result without a pass over the files.
+*/
+
+typedef struct {
+  file_list * list;
+  buffer ** buffers;
+  size_t (* histograms)[256];
+  size_t (* sketches)[SKETCH_BINS];
+} corpus;
+
+void corpus_destroy(corpus * const corpus_) {
+  size_t i = 0;
+
+  if (corpus_) {
+    if (corpus_->buffers) {
+      for (i = 0; i < corpus_->list->count; ++i) {
+        buffer_destroy(corpus_->buffers[i]);
+      }
+    }
+    free(corpus_->buffers);
+    free(corpus_->histograms);
+    free(corpus_->sketches);
+    file_list_destroy(corpus_->list);
+  }
+  free(corpus_);
+}
+
+int corpus_create(char const * const list_path,
+                  size_t const max_size,
+                  corpus ** const corpus_) {
+  corpus * corp = NULL;
+  int ret = 0;
+  size_t i = 0;
+
+  corp = stats_calloc( 1, sizeof(*corp) );
+  if (!corp) {
+    return 1;
+  }
+  ret = file_list_create(list_path, &corp->list);
+  if (ret) {
+    fprintf(stderr, "Error: Could not read list file.\n");
+    free(corp);
+    return ret;
+  }
+  corp->buffers = stats_calloc( corp->list->count + 1, sizeof(*corp->buffers) );
+  corp->histograms = stats_calloc( corp->list->count + 1, sizeof(*corp->histograms) );
+  corp->sketches = stats_calloc( corp->list->count + 1, sizeof(*corp->sketches) );
+  if (!corp->buffers || !corp->histograms || !corp->sketches) {
+    corpus_destroy(corp);
+    return 1;
+  }
+  for (i = 0; i < corp->list->count; ++i) {
+    ret = buffer_create(corp->list->paths[i], max_size, &corp->buffers[i]);
+    if (ret) {
+      fprintf(stderr, "Error: Could not read file %s.\n", corp->list->paths[i]);
+      corpus_destroy(corp);
+      return ret;
+    }
+    get_histogram(corp->buffers[i], corp->histograms[i]);
+    get_sketch(corp->buffers[i], corp->sketches[i]);
+  }
+
+  *corpus_ = corp;
+  return 0;
+}
+
+int corpus_get_result(corpus const * const corpus_,
+                      measure const * const measure_,
+                      size_t const index_1,
+                      size_t const index_2,
+                      size_t * const result) {
+  if (measure_->option == 'l') {
+    return get_lb_from_summaries(measure_,
+                                 corpus_->histograms[index_1],
+                                 corpus_->sketches[index_1],
+                                 corpus_->buffers[index_1]->size,
+                                 corpus_->histograms[index_2],
+                                 corpus_->sketches[index_2],
+                                 corpus_->buffers[index_2]->size,
+                                 result);
+  }
+  return get_result(measure_,
+                    corpus_->buffers[index_1],
+                    corpus_->buffers[index_2],
+                    result);
+}
+
+
+
+/*  Nearest neighbours
+
+    get_top_k finds the (at most) k files of a corpus that are closest to a
+    given file of the corpus, ordered by distance. It computes the distances
+    in the order of ascending lower bounds, and it stops as soon as the lower
+    bound exceeds the k-th smallest distance found so far.
+*/
+
+typedef struct {
+  size_t bound;
+  size_t index;
+} candidate;
+
+int candidate_compare(void const * const op1,
+                      void const * const op2) {
+  candidate const * const candidate_1 = op1;
+  candidate const * const candidate_2 = op2;
+
+  if (candidate_1->bound != candidate_2->bound) {
+    return candidate_1->bound < candidate_2->bound ? -1 : 1;
+  }
+  if (candidate_1->index != candidate_2->index) {
+    return candidate_1->index < candidate_2->index ? -1 : 1;
+  }
+  return 0;
+}
+
+int get_top_k(corpus const * const corpus_,
+              measure const * const measure_, /* the option is ignored */
+              size_t const index,
+              size_t const k,
+              candidate * const nearest, /* indices: 0, ..., k - 1 */
+              size_t * const count) {
+  measure bound_measure = *measure_;
+  measure distance_measure = *measure_;
+  int ret = 0;
+  candidate * candidates = NULL;
+  size_t candidate_count = 0;
+  size_t found = 0;
+  size_t distance_ = 0;
+  size_t i = 0;
+  size_t j = 0;
+
+  bound_measure.option = 'l';
+  distance_measure.option = 'd';
+  candidates = stats_calloc( corpus_->list->count + 1, sizeof(*candidates) );
+  if (!candidates) {
+    return 1;
+  }
+  for (i = 0; i < corpus_->list->count; ++i) {
+    if (i == index) {
+      continue;
+    }
+    ret = corpus_get_result(corpus_, &bound_measure, index, i,
+                            &candidates[candidate_count].bound);
+    if (ret) {
+      free(candidates);
+      return ret;
+    }
+    candidates[candidate_count++].index = i;
+  }
+  qsort( candidates, candidate_count, sizeof(*candidates), candidate_compare );
+
+  for (i = 0; i < candidate_count && k; ++i) {
+    if (found == k &&
+        candidates[i].bound >= nearest[k - 1].bound) {
+      break;
+    }
+    ret = corpus_get_result(corpus_, &distance_measure, index, candidates[i].index,
+                            &distance_);
+    if (ret) {
+      free(candidates);
+      return ret;
+    }
+    if (found == k) {
+      if (distance_ >= nearest[k - 1].bound) {
+        continue;
+      }
+      --found;
+    }
+    for (j = found; j > 0 && nearest[j - 1].bound > distance_; --j) {
+      nearest[j] = nearest[j - 1];
+    }
+    nearest[j].bound = distance_;
+    nearest[j].index = candidates[i].index;
+    ++found;
+  }
+
+  free(candidates);
+  *count = found;
+  return 0;
+}
+
+
+
+/*  Comparing units
+
+    Text is often better compared line by line, or token by token, than byte
+    by byte. A unit is a line (including its newline, if any) or a token (a
+    maximal run of non-whitespace bytes). Units are identified by the 64-bit
+    hashes of their contents (including the newline); equal hashes are assumed
+    to mean equal units. Before a comparison, the units of both bytestrings are
+    numbered by their hashes, so that equal units, and only those, get equal
+    ids. Units with equal ids thus have equal sizes, which the trimming of
+    common prefixes and suffixes relies on: a last line without a newline
+    differs from the same line with one.
+
+    Each result comes in two kinds: the unit result counts unit operations;
+    the weighted result charges an insertion or deletion of a unit with its
+    size in bytes and a substitution with the larger of both sizes.
+*/
+
+typedef struct {
+  size_t * ids;
+  size_t * sizes;
+  size_t count;
+} unit_sequence;
+
+typedef struct {
+  uint64_t hash;
+  size_t index;
+} unit_key;
+
+typedef struct {
+  size_t id;
+  size_t position;
+} unit_position;
+
+void unit_sequence_destroy(unit_sequence * const sequence) {
+  if (sequence) {
+    free(sequence->ids);
+    free(sequence->sizes);
+  }
+  free(sequence);
+}
+
+int is_space(char const c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\v' || c == '\f' || c == '\r';
+}
+
+/*  split_units returns the number of units of the given kind ('l' for lines,
+    't' for tokens) in the bytestring. If keys is not NULL, it also stores
+    the hash of each unit in keys (with indices from first_index on) and its
+    size in sizes.
+*/
+
+size_t split_units(char const kind,
+                   buffer const * const buffer_,
+                   unit_key * const keys,
+                   size_t * const sizes,
+                   size_t const first_index) {
+  char const * const pointer = buffer_->pointer;
+  uint64_t hash[2];
+  size_t count = 0;
+  size_t start = 0;
+  size_t end = 0;
+  size_t next = 0;
+
+  while (start < buffer_->size) {
+    if (kind == 'l') {
+      for (end = start; end < buffer_->size && pointer[end] != '\n'; ++end) {
+      }
+      next = end < buffer_->size ? end + 1 : end;
+    }
+    else {
+      while ( start < buffer_->size && is_space(pointer[start]) ) {
+        ++start;
+      }
+      if (start == buffer_->size) {
+        break;
+      }
+      for (end = start; end < buffer_->size && !is_space(pointer[end]); ++end) {
+      }
+      next = end;
+    }
+    if (keys) {
+      hash_128(pointer + start, next - start, hash);
+      keys[count].hash = hash[0];
+      keys[count].index = first_index + count;
+      sizes[count] = next - start;
+    }
+    ++count;
+    start = next;
+  }
+  return count;
+}
+
+int unit_key_compare(void const * const op1,
+                     void const * const op2) {
+  unit_key const * const key_1 = op1;
+  unit_key const * const key_2 = op2;
+
+  if (key_1->hash != key_2->hash) {
+    return key_1->hash < key_2->hash ? -1 : 1;
+  }
+  return 0;
+}
+
+/*  unit_sequences_create splits both bytestrings into units and numbers them;
+    the ids are below *id_count.
+*/
+
+int unit_sequences_create(char const kind,
+                          buffer const * const buffer_1,
+                          buffer const * const buffer_2,
+                          unit_sequence ** const sequence_1,
+                          unit_sequence ** const sequence_2,
+                          size_t * const id_count) {
+  unit_sequence * sequences[2] = {NULL, NULL};
+  unit_key * keys = NULL;
+  size_t counts[2];
+  size_t id = 0;
+  size_t k = 0;
+  size_t s = 0;
+
+  counts[0] = split_units(kind, buffer_1, NULL, NULL, 0);
+  counts[1] = split_units(kind, buffer_2, NULL, NULL, 0);
+  keys = stats_calloc( counts[0] + counts[1] + 1, sizeof(*keys) );
+  for (s = 0; s < 2; ++s) {
+    sequences[s] = stats_calloc( 1, sizeof(*sequences[s]) );
+    if (sequences[s]) {
+      sequences[s]->count = counts[s];
+      sequences[s]->ids = stats_calloc( counts[s] + 1, sizeof(*sequences[s]->ids) );
+      sequences[s]->sizes = stats_calloc( counts[s] + 1, sizeof(*sequences[s]->sizes) );
+    }
+  }
+  if ( !keys || !sequences[0] || !sequences[1] ||
+       !sequences[0]->ids || !sequences[0]->sizes ||
+       !sequences[1]->ids || !sequences[1]->sizes ) {
+    unit_sequence_destroy(sequences[1]);
+    unit_sequence_destroy(sequences[0]);
+    free(keys);
+    return 1;
+  }
+
+  split_units(kind, buffer_1, keys, sequences[0]->sizes, 0);
+  split_units(kind, buffer_2, keys + counts[0], sequences[1]->sizes, counts[0]);
+  qsort( keys, counts[0] + counts[1], sizeof(*keys), unit_key_compare );
+  for (k = 0; k < counts[0] + counts[1]; ++k) {
+    if (k && keys[k].hash != keys[k - 1].hash) {
+      ++id;
+    }
+    if (keys[k].index < counts[0]) {
+      sequences[0]->ids[keys[k].index] = id;
+    }
+    else {
+      sequences[1]->ids[keys[k].index - counts[0]] = id;
+    }
+  }
+
+  free(keys);
+  *sequence_1 = sequences[0];
+  *sequence_2 = sequences[1];
+  *id_count = counts[0] + counts[1] ? id + 1 : 0;
+  return 0;
+}
+
+size_t saturated_add(size_t const op1, size_t const op2) {
+  return op1 > SIZE_MAX - op2 ? SIZE_MAX : op1 + op2;
+}
+
+int unit_position_compare(void const * const op1,
+                          void const * const op2) {
+  unit_position const * const position_1 = op1;
+  unit_position const * const position_2 = op2;
+
+  if (position_1->id != position_2->id) {
+    return position_1->id < position_2->id ? -1 : 1;
+  }
+  if (position_1->position != position_2->position) {
+    return position_1->position < position_2->position ? -1 : 1;
+  }
+  return 0;
+}
+
+/*  get_unit_distance computes the unit distance bit-parallel, like
+    get_levenshtein_distance_masked. There are too many ids for match masks
+    per id; instead, the positions of the units of the pattern are sorted by
+    id, and the match mask for a unit of the text is assembled from the
+    positions of its id, then cleared again.
+*/
+
+int get_unit_distance(unit_sequence const * const sequence_1,
+                      unit_sequence const * const sequence_2,
+                      size_t * const distance) {
+  unit_sequence const * pattern = sequence_1;
+  unit_sequence const * text = sequence_2;
+  unit_position * positions = NULL;
+  size_t word_count = 0;
+  uint64_t * vp = NULL;
+  uint64_t * vn = NULL;
+  uint64_t * eq = NULL;
+  uint64_t hp_in = 0;
+  uint64_t hn_in = 0;
+  unsigned int shift = 63;
+  size_t score = 0;
+  size_t first = 0;
+  size_t low = 0;
+  size_t high = 0;
+  size_t i = 0;
+  size_t j = 0;
+  size_t w = 0;
+  STATS_TIMER(timer)
+
+  if (sequence_2->count < sequence_1->count) {
+    pattern = sequence_2;
+    text = sequence_1;
+  }
+  if (!pattern->count) {
+    *distance = text->count;
+    return 0;
+  }
+  STATS_START(timer);
+  word_count = get_word_count(pattern->count);
+  positions = stats_calloc( pattern->count, sizeof(*positions) );
+  vp = stats_calloc( 3 * word_count, sizeof(*vp) );
+  if (!positions || !vp) {
+    free(vp);
+    free(positions);
+    return 1;
+  }
+  vn = vp + word_count;
+  eq = vn + word_count;
+  for (w = 0; w < word_count; ++w) {
+    vp[w] = ~(uint64_t)0;
+  }
+  for (i = 0; i < pattern->count; ++i) {
+    positions[i].id = pattern->ids[i];
+    positions[i].position = i;
+  }
+  qsort( positions, pattern->count, sizeof(*positions), unit_position_compare );
+
+  score = pattern->count;
+  for (j = 0; j < text->count; ++j) {
+    /* first: the first position with an id that is not less */
+    low = 0;
+    high = pattern->count;
+    while (low < high) {
+      i = low + (high - low) / 2;
+      if (positions[i].id < text->ids[j]) {
+        low = i + 1;
+      }
+      else {
+        high = i;
+      }
+    }
+    first = low;
+    for (i = first; i < pattern->count && positions[i].id == text->ids[j]; ++i) {
+      eq[positions[i].position / 64] |= (uint64_t)1 << (positions[i].position % 64);
+    }
+
+    hp_in = 1; /* The first row grows by one per column. */
+    hn_in = 0;
+    for (w = 0; w < word_count; ++w) {
+      if (w + 1 == word_count) {
+        shift = (unsigned int)( (pattern->count - 1) % 64 );
+      }
+      bit_parallel_step(&vp[w], &vn[w], eq[w], &hp_in, &hn_in, shift);
+    }
+    shift = 63;
+    score += hp_in;
+    score -= hn_in;
+
+    for (i = first; i < pattern->count && positions[i].id == text->ids[j]; ++i) {
+      eq[positions[i].position / 64] = 0;
+    }
+  }
+
+  free(vp);
+  free(positions);
+  *distance = score;
+  STATS_STOP(timer, STATS_DP);
+  STATS_COUNT(STATS_CELLS, (double)pattern->count * text->count);
+  return 0;
+}
+
+/*  get_banded_unit_distance computes the weighted distance, or the unit
+    distance if weighted is 0, within a band of the dynamic programming:
+    |i - j| <= band, for row i and column j. An alignment that leaves the band
+    makes more than band insertions and deletions, each of which costs at
+    least min_size; so, if the result is less than (band + 1) * min_size, it is
+    exact. Otherwise, the band is doubled (Ukkonen's band doubling); once it
+    would exceed max_band, the distance is given as SIZE_MAX.
+*/
+
+int get_banded_unit_distance(unit_sequence const * const sequence_1,
+                             unit_sequence const * const sequence_2,
+                             int const weighted,
+                             size_t const max_band,
+                             size_t * const banded_distance) {
+  size_t const count_1 = sequence_1->count;
+  size_t const count_2 = sequence_2->count;
+  size_t const count_max = maximum(count_1, count_2);
+  size_t * rows = NULL;
+  size_t * row_1 = NULL;
+  size_t * row_2 = NULL;
+  size_t * row_t = NULL;
+  size_t const * sizes_1 = sequence_1->sizes;
+  size_t const * sizes_2 = sequence_2->sizes;
+  size_t * ones = NULL;
+  size_t min_size = SIZE_MAX;
+  size_t band = 0;
+  size_t low = 0;
+  size_t high = 0;
+  size_t cost = 0;
+  size_t t = 0;
+  size_t i = 0;
+  size_t j = 0;
+  double cells = 0;
+  STATS_TIMER(timer)
+
+  STATS_START(timer);
+  rows = stats_calloc( 2 * (count_2 + 1) + count_max, sizeof(*rows) );
+  if (!rows) {
+    return 1;
+  }
+  if (!weighted) {
+    ones = rows + 2 * (count_2 + 1);
+    for (i = 0; i < count_max; ++i) {
+      ones[i] = 1;
+    }
+    sizes_1 = ones;
+    sizes_2 = ones;
+  }
+  for (i = 0; i < count_1; ++i) {
+    min_size = minimum(min_size, sizes_1[i]);
+  }
+  for (j = 0; j < count_2; ++j) {
+    min_size = minimum(min_size, sizes_2[j]);
+  }
+  band = maximum(distance(count_1, count_2), 1);
+
+  for (;;) {
+    if (band > max_band) {
+      free(rows);
+      *banded_distance = SIZE_MAX;
+      STATS_STOP(timer, STATS_DP);
+      STATS_COUNT(STATS_CELLS, cells);
+      return 0;
+    }
+    row_1 = rows;
+    row_2 = rows + count_2 + 1;
+    for (j = 0; j < 2 * (count_2 + 1); ++j) {
+      rows[j] = SIZE_MAX;
+    }
+    row_1[0] = 0;
+    for (j = 1; j <= minimum(count_2, band); ++j) {
+      row_1[j] = row_1[j - 1] + sizes_2[j - 1];
+    }
+
+    for (i = 1; i <= count_1; ++i) {
+      low = i > band ? i - band : 0;
+      high = minimum(count_2, saturated_add(i, band));
+      if (low) {
+        row_2[low - 1] = SIZE_MAX;
+      }
+      else {
+        row_2[0] = saturated_add(row_1[0], sizes_1[i - 1]);
+        low = 1;
+      }
+      for (j = low; j <= high; ++j) {
+        cost = 0;
+        if (sequence_1->ids[i - 1] != sequence_2->ids[j - 1]) {
+          cost = maximum(sizes_1[i - 1], sizes_2[j - 1]);
+        }
+        t = saturated_add(row_1[j - 1], cost);
+        t = minimum( t, saturated_add(row_1[j], sizes_1[i - 1]) );
+        t = minimum( t, saturated_add(row_2[j - 1], sizes_2[j - 1]) );
+        row_2[j] = t;
+      }
+      cells += (double)(high + 1 - low);
+      row_t = row_1;
+      row_1 = row_2;
+      row_2 = row_t;
+    }
+
+    if ( band >= count_max ||
+         min_size && row_1[count_2] / min_size <= band ) {
+      break;
+    }
+    band = minimum( saturated_add(band, band), count_max );
+  }
+
+  *banded_distance = row_1[count_2];
+  free(rows);
+  STATS_STOP(timer, STATS_DP);
+  STATS_COUNT(STATS_CELLS, cells);
+  return 0;
+}
+
+/*  get_unit_distances computes the unit distance (distances[0]) and the
+    weighted distance (distances[1]). For the unit distance, the band is only
+    tried as long as it is narrower than twice the number of words per column
+    of get_unit_distance.
+*/
+
+int get_unit_distances(unit_sequence const * const sequence_1,
+                       unit_sequence const * const sequence_2,
+                       size_t distances[2]) {
+  size_t const max_band = 2 * get_word_count( minimum(sequence_1->count,
+                                                      sequence_2->count) );
+  int ret = 0;
+
+  ret = get_banded_unit_distance(sequence_1, sequence_2, 0, max_band, &distances[0]);
+  if (!ret && distances[0] == SIZE_MAX) {
+    ret = get_unit_distance(sequence_1, sequence_2, &distances[0]);
+  }
+  if (!ret) {
+    ret = get_banded_unit_distance(sequence_1, sequence_2, 1, SIZE_MAX, &distances[1]);
+  }
+  return ret;
+}
+
+/*  get_unit_lb bounds both kinds of distance from below by the id histograms:
+    an operation removes at most two from the sum of the histogram differences,
+    and a substitution at least costs the mean of both sizes.
+*/
+
+int get_unit_lb(unit_sequence const * const sequence_1,
+                unit_sequence const * const sequence_2,
+                size_t const id_count,
+                size_t bounds[2]) {
+  size_t * counts = NULL;
+  size_t * id_sizes = NULL; /* the size of the units with the id */
+  size_t sum = 0;
+  size_t weighted_sum = 0;
+  size_t id = 0;
+  size_t i = 0;
+
+  counts = stats_calloc( 2 * id_count + 1, sizeof(*counts) );
+  id_sizes = stats_calloc( id_count + 1, sizeof(*id_sizes) );
+  if (!counts || !id_sizes) {
+    free(id_sizes);
+    free(counts);
+    return 1;
+  }
+  for (id = 0; id < id_count; ++id) {
+    id_sizes[id] = SIZE_MAX;
+  }
+  for (i = 0; i < sequence_1->count; ++i) {
+    ++counts[2 * sequence_1->ids[i]];
+    id_sizes[sequence_1->ids[i]] = minimum(id_sizes[sequence_1->ids[i]],
+                                           sequence_1->sizes[i]);
+  }
+  for (i = 0; i < sequence_2->count; ++i) {
+    ++counts[2 * sequence_2->ids[i] + 1];
+    id_sizes[sequence_2->ids[i]] = minimum(id_sizes[sequence_2->ids[i]],
+                                           sequence_2->sizes[i]);
+  }
+  for (id = 0; id < id_count; ++id) {
+    i = distance(counts[2 * id], counts[2 * id + 1]);
+    sum += i;
+    weighted_sum += i * id_sizes[id];
+  }
+  sum += distance(sequence_1->count, sequence_2->count);
+
+  bounds[0] = sum / 2 + sum % 2;
+  bounds[1] = weighted_sum / 2 + weighted_sum % 2;
+  free(id_sizes);
+  free(counts);
+  return 0;
+}
+
+/*  get_unit_ub bounds both kinds of distance from above, like get_ld_ub, by
+    comparing the sequences in chunks of 1024 units.
+*/
+
+int get_unit_ub(unit_sequence const * const sequence_1,
+                unit_sequence const * const sequence_2,
+                size_t bounds[2]) {
+  unit_sequence chunks[2];
+  size_t rests[2];
+  size_t distances[2];
+  int ret = 0;
+
+  bounds[0] = 0;
+  bounds[1] = 0;
+  chunks[0] = *sequence_1;
+  chunks[1] = *sequence_2;
+  rests[0] = sequence_1->count;
+  rests[1] = sequence_2->count;
+  chunks[0].count = minimum(rests[0], 1024);
+  chunks[1].count = minimum(rests[1], 1024);
+
+  while (chunks[0].count ||
+         chunks[1].count) {
+    ret = get_unit_distances(&chunks[0], &chunks[1], distances);
+    if (ret) {
+      return ret;
+    }
+    bounds[0] += distances[0];
+    bounds[1] = saturated_add(bounds[1], distances[1]);
+
+    rests[0] -= chunks[0].count;
+    rests[1] -= chunks[1].count;
+    chunks[0].ids += chunks[0].count;
+    chunks[0].sizes += chunks[0].count;
+    chunks[1].ids += chunks[1].count;
+    chunks[1].sizes += chunks[1].count;
+    chunks[0].count = minimum(rests[0], chunks[0].count);
+    chunks[1].count = minimum(rests[1], chunks[1].count);
+  }
+  return 0;
+}
+
+/*  unit_sequences_trim removes the common prefix and the common suffix of
+    both sequences, which the distances of both kinds do not depend on.
+*/
+
+void unit_sequences_trim(unit_sequence * const sequence_1,
+                         unit_sequence * const sequence_2) {
+  size_t prefix = 0;
+
+  while (prefix < sequence_1->count && prefix < sequence_2->count &&
+         sequence_1->ids[prefix] == sequence_2->ids[prefix]) {
+    ++prefix;
+  }
+  sequence_1->ids += prefix;
+  sequence_1->sizes += prefix;
+  sequence_1->count -= prefix;
+  sequence_2->ids += prefix;
+  sequence_2->sizes += prefix;
+  sequence_2->count -= prefix;
+  while (sequence_1->count && sequence_2->count &&
+         sequence_1->ids[sequence_1->count - 1] == sequence_2->ids[sequence_2->count - 1]) {
+    --sequence_1->count;
+    --sequence_2->count;
+  }
+}
+
+/*  get_units_result computes the unit result (results[0]) and the weighted
+    result (results[1]) of the option for the units of the given kind.
+*/
+
+int get_units_result(char const option,
+                     char const kind,
+                     buffer const * const buffer_1,
+                     buffer const * const buffer_2,
+                     size_t results[2]) {
+  unit_sequence * sequence_1 = NULL;
+  unit_sequence * sequence_2 = NULL;
+  unit_sequence trimmed_1;
+  unit_sequence trimmed_2;
+  size_t id_count = 0;
+  int ret = 0;
+
+  ret = unit_sequences_create(kind, buffer_1, buffer_2,
+                              &sequence_1, &sequence_2, &id_count);
+  if (ret) {
+    return ret;
+  }
+  switch (option) {
+  case 'd':
+    trimmed_1 = *sequence_1;
+    trimmed_2 = *sequence_2;
+    unit_sequences_trim(&trimmed_1, &trimmed_2);
+    ret = get_unit_distances(&trimmed_1, &trimmed_2, results);
+    break;
+  case 'l':
+    ret = get_unit_lb(sequence_1, sequence_2, id_count, results);
+    break;
+  case 'u':
+    ret = get_unit_ub(sequence_1, sequence_2, results);
+    break;
+  default:
+    ret = 1;
+  }
+  unit_sequence_destroy(sequence_2);
+  unit_sequence_destroy(sequence_1);
+  return ret;
+}
+
+
+
+/*  Reporting all results
+
+    all_run computes the bounds and the distance of a pair at once and prints
+    them as a JSON object. The stages share their work: the common prefix and
+    the common suffix are removed once (except for weighted costs), the lower
+    and the upper bound of the remainders are computed concurrently, and the
+    distance stage plans with the lower bound. If the bounds meet, the
+    distance stage is skipped. With a threshold k, the distance stage only
+    decides whether the distance is at most k: for the Levenshtein metric, the
+    planner picks the diagonal engine, stopped after k edits, if it is cheaper
+    than the bit-parallel engine, and the distance is null if it exceeds k. The
+    timings are wall clock times in seconds; load covers reading both files.
+*/
+
+typedef struct {
+  measure measure_;
+  buffer const * buffers[2];
+  size_t result;
+  double time;
+  int ret;
+} all_stage;
+
+void * all_stage_run(void * const stage_) {
+  all_stage * const stage = stage_;
+  double const begin = get_time();
+
+  stage->ret = get_result(&stage->measure_, stage->buffers[0], stage->buffers[1],
+                          &stage->result);
+  stage->time = get_time() - begin;
+  return NULL;
+}
+
+int all_run(measure const * const measure_,
+            buffer const * const buffer_1,
+            buffer const * const buffer_2,
+            size_t const threshold, /* SIZE_MAX for none */
+            double const load_time) {
+  buffer remainders[2];
+  all_stage stages[2]; /* the lower and the upper bound */
+  thread thread_;
+  plan plan_;
+  measure distance_measure = *measure_;
+  size_t prefix_size = 0;
+  size_t suffix_size = 0;
+  size_t distance = SIZE_MAX;
+  char const * engine = "bounds";
+  double begin = get_time();
+  double trim_time = 0;
+  double distance_time = 0;
+  size_t s = 0;
+  int ret = 0;
+
+  if (measure_->metric == 'w') {
+    memset( remainders, 0, sizeof(remainders) );
+    remainders[0] = *buffer_1;
+    remainders[1] = *buffer_2;
+  }
+  else {
+    get_remainders(buffer_1, buffer_2, &prefix_size, &suffix_size, remainders);
+  }
+  trim_time = get_time() - begin;
+
+  memset( stages, 0, sizeof(stages) );
+  memset( &thread_, 0, sizeof(thread_) );
+  for (s = 0; s < 2; ++s) {
+    stages[s].measure_ = *measure_;
+    stages[s].measure_.option = s ? 'u' : 'l';
+    stages[s].buffers[0] = &remainders[0];
+    stages[s].buffers[1] = &remainders[1];
+  }
+  if ( thread_start(&thread_, all_stage_run, &stages[1]) ) {
+    all_stage_run(&stages[1]);
+  }
+  all_stage_run(&stages[0]);
+  thread_join(&thread_);
+  if (stages[0].ret || stages[1].ret) {
+    fprintf(stderr, "Error: Computation failed.\n");
+    return 1;
+  }
+
+  begin = get_time();
+  if (stages[0].result == stages[1].result) {
+    distance = stages[0].result;
+  }
+  else if (threshold != SIZE_MAX && stages[0].result > threshold) {
+    distance = SIZE_MAX;
+  }
+  else if (measure_->metric == 'w') {
+    engine = "weighted";
+    distance_measure.option = 'd';
+    ret = get_result(&distance_measure, &remainders[0], &remainders[1], &distance);
+  }
+  else {
+    ret = get_plan(measure_->metric, measure_->calibration_, measure_->max_memory,
+                   &remainders[0], &remainders[1],
+                   measure_->metric == 'l' ? &stages[0].result : NULL, threshold,
+                   &plan_) ||
+          plan_run(&plan_, measure_->metric, NULL, &distance);
+    engine = get_engine_name(plan_.engine);
+  }
+  distance_time = get_time() - begin;
+  if (ret) {
+    fprintf(stderr, "Error: Computation failed.\n");
+    return ret;
+  }
+  if (distance != SIZE_MAX && distance > threshold) {
+    distance = SIZE_MAX;
+  }
+
+  ret = printf("{\"sizes\": [%" SIZE_T_FORMAT ", %" SIZE_T_FORMAT "], "
+               "\"common_prefix\": %" SIZE_T_FORMAT ", "
+               "\"common_suffix\": %" SIZE_T_FORMAT ", "
+               "\"lower_bound\": %" SIZE_T_FORMAT ", "
+               "\"upper_bound\": %" SIZE_T_FORMAT ", ",
+               buffer_1->size, buffer_2->size, prefix_size, suffix_size,
+               stages[0].result, stages[1].result) < 0;
+  if (!ret && threshold != SIZE_MAX) {
+    ret = printf("\"threshold\": %" SIZE_T_FORMAT ", ", threshold) < 0;
+  }
+  if (!ret && distance == SIZE_MAX) {
+    ret = printf("\"distance\": null, ") < 0;
+  }
+  else if (!ret) {
+    ret = printf("\"distance\": %" SIZE_T_FORMAT ", ", distance) < 0;
+  }
+  if (!ret) {
+    ret = printf("\"engine\": \"%s\", \"timings\": {\"load\": %.6f, "
+                 "\"trim\": %.6f, \"lower_bound\": %.6f, \"upper_bound\": %.6f, "
+                 "\"distance\": %.6f}}\n",
+                 engine, load_time, trim_time, stages[0].time, stages[1].time,
+                 distance_time) < 0;
+  }
+  return ret;
+}
+
+
+
+/*  Comparing windows
+
+    windows_run compares two bytestrings window by window, to show where they
+    diverge: the i-th window of each bytestring holds its bytes from
+    i * window_size on, up to window_size of them (fewer, or none, at its end).
+    For each i, the line "offset result" is printed, where offset is
+    i * window_size and the result is that of the option for the two i-th
+    windows. Like the chunks of get_ld_ub, the windows are aligned by offset;
+    thus, the results add up to an upper bound on the distance. The windows are
+    compared in parallel.
+*/
+
+typedef struct {
+  measure measure_;
+  mapping const * files[2];
+  size_t sizes[2]; /* after the read limit */
+  size_t window_size;
+  cache * cache_;
+  size_t * results;
+} windows_context;
+
+void window_get(mapping const * const file,
+                size_t const size,
+                size_t const offset,
+                size_t const window_size,
+                buffer * const window) {
+  memset( window, 0, sizeof(*window) );
+  if (offset < size) {
+    window->pointer = (char *)file->pointer + offset;
+    window->size = minimum(window_size, size - offset);
+  }
+  hash_128(window->pointer, window->size, window->hash);
+}
+
+int windows_compute(void * const context_, size_t const index) {
+  windows_context const * const context = context_;
+  size_t const offset = index * context->window_size;
+  buffer window_1;
+  buffer window_2;
+
+  window_get(context->files[0], context->sizes[0], offset, context->window_size,
+             &window_1);
+  window_get(context->files[1], context->sizes[1], offset, context->window_size,
+             &window_2);
+  return get_cached_result(context->cache_, &context->measure_, &window_1, &window_2,
+                           &context->results[index]);
+}
+
+int windows_run(measure const * const measure_,
+                char const * const file_path_1,
+                char const * const file_path_2,
+                size_t const window_size,
+                size_t const max_size,
+                size_t const thread_count,
+                cache * const cache_) {
+  windows_context context;
+  mapping * file_1 = NULL;
+  mapping * file_2 = NULL;
+  size_t size = 0;
+  size_t count = 0;
+  size_t i = 0;
+  int ret = 0;
+
+  ret = mapping_create(file_path_1, &file_1);
+  if (ret) {
+    fprintf(stderr, "Error: Could not read first file.\n");
+    return ret;
+  }
+  ret = mapping_create(file_path_2, &file_2);
+  if (ret) {
+    mapping_destroy(file_1);
+    fprintf(stderr, "Error: Could not read second file.\n");
+    return ret;
+  }
+
+  memset( &context, 0, sizeof(context) );
+  context.measure_ = *measure_;
+  context.files[0] = file_1;
+  context.files[1] = file_2;
+  context.sizes[0] = minimum(file_1->size, max_size);
+  context.sizes[1] = minimum(file_2->size, max_size);
+  context.window_size = window_size;
+  context.cache_ = cache_;
+  size = maximum(context.sizes[0], context.sizes[1]);
+  count = size / window_size + (size % window_size != 0);
+  context.results = stats_calloc( count + 1, sizeof(*context.results) );
+  ret = !context.results ||
+        parallel_for(count, thread_count, windows_compute, &context);
+  if (ret) {
+    fprintf(stderr, "Error: Computation failed.\n");
+  }
+  for (i = 0; !ret && i < count; ++i) {
+    ret = printf("%" SIZE_T_FORMAT " %" SIZE_T_FORMAT "\n",
+                 i * window_size, context.results[i]) < 0;
+  }
+
+  free(context.results);
+  mapping_destroy(file_2);
+  mapping_destroy(file_1);
+  return ret;
+}
+
+
+
+/*  Streaming records
+
+    stream_run reads records, separated by the delimiter, from the input and
+    prints the distance of each record, one per line, in input order. Each
+    record is compared either with the reference or, if there is no
+    reference, the part of the record before its first tab is compared with
+    the part after it. The input is read in large blocks; records are slices of
+    the block, not copies. A comparison whose shorter side has up to
+    LANE_PATTERN_SIZE bytes goes into a lane group, so that short records are
+    compared LANE_COUNT at a time; the distances of a block are printed once all
+    of its comparisons are done.
+*/
+
+#define STREAM_BLOCK_SIZE ((size_t)1 << 20)
+
+typedef struct {
+  int has_reference;
+  record reference;
+  match_masks * masks; /* of the reference, if it does not fit into a lane */
+  lane_group * group;
+  size_t lane_indices[LANE_COUNT];
+  size_t * distances; /* of the records of the current block */
+  size_t capacity;
+} stream;
+
+void stream_run_group(stream * const stream_) {
+  size_t lane_distances[LANE_COUNT];
+  size_t const count = stream_->group->count;
+  size_t l = 0;
+
+  lane_group_run(stream_->group, lane_distances);
+  for (l = 0; l < count; ++l) {
+    stream_->distances[stream_->lane_indices[l]] = lane_distances[l];
+  }
+}
+
+/*  stream_compare computes the distance of the index-th record of the block
+    into distances[index]; if it goes into the lane group, the distance is only
+    there after stream_run_group.
+*/
+
+int stream_compare(stream * const stream_,
+                   record const * const record_1,
+                   record const * const record_2,
+                   int const is_reference,
+                   size_t const index) {
+  record const * pattern = record_1;
+  record const * text = record_2;
+  size_t * distances = NULL;
+  size_t capacity = 0;
+  buffer buffer_1;
+  buffer buffer_2;
+  int ret = 0;
+  STATS_TIMER(timer)
+
+  if (index >= stream_->capacity) {
+    if ( size_t_mul(&capacity, stream_->capacity, 2) ) {
+      return 1;
+    }
+    distances = stats_realloc( stream_->distances, capacity * sizeof(*distances) );
+    if (!distances) {
+      return 1;
+    }
+    stream_->distances = distances;
+    stream_->capacity = capacity;
+  }
+
+  if (text->size < pattern->size) {
+    pattern = record_2;
+    text = record_1;
+  }
+  if (pattern->size <= LANE_PATTERN_SIZE) {
+    stream_->lane_indices[stream_->group->count] = index;
+    lane_group_add(stream_->group, pattern->pointer, pattern->size,
+                   text->pointer, text->size);
+    if (stream_->group->count == LANE_COUNT) {
+      stream_run_group(stream_);
+    }
+    return 0;
+  }
+  if (is_reference && stream_->masks) {
+    STATS_START(timer);
+    ret = get_levenshtein_distance_masked(stream_->masks->words,
+                                          stream_->masks->stride,
+                                          stream_->masks->rows,
+                                          stream_->masks->size,
+                                          record_2->pointer, record_2->size,
+                                          &stream_->distances[index]);
+    if (!ret) {
+      STATS_STOP(timer, STATS_DP);
+      STATS_COUNT(STATS_CELLS, (double)stream_->masks->size * record_2->size);
+    }
+    return ret;
+  }
+  memset( &buffer_1, 0, sizeof(buffer_1) );
+  memset( &buffer_2, 0, sizeof(buffer_2) );
+  buffer_1.pointer = (char *)record_1->pointer;
+  buffer_1.size = record_1->size;
+  buffer_2.pointer = (char *)record_2->pointer;
+  buffer_2.size = record_2->size;
+  return get_levenshtein_distance_bit_parallel(&buffer_1, &buffer_2,
+                                               &stream_->distances[index]);
+}
+
+/*  stream_block compares the records of the block; *used is set to the size of
+    the records, including their delimiters. The final record of the input
+    need not end with a delimiter.
+*/
+
+int stream_block(stream * const stream_,
+                 char const delimiter,
+                 char const * const block,
+                 size_t const size,
+                 int const is_final,
+                 size_t * const used,
+                 size_t * const count) {
+  char const * end = NULL;
+  record record_1;
+  record record_2;
+  size_t start = 0;
+  size_t next = 0;
+  size_t k = 0;
+  int ret = 0;
+
+  while (start < size) {
+    end = memchr(block + start, delimiter, size - start);
+    if (end) {
+      next = end - block + 1;
+    }
+    else if (is_final) {
+      end = block + size;
+      next = size;
+    }
+    else {
+      break;
+    }
+    record_1.pointer = block + start;
+    record_1.size = end - record_1.pointer;
+    if (stream_->has_reference) {
+      ret = stream_compare(stream_, &stream_->reference, &record_1, 1, k);
+    }
+    else {
+      end = memchr(record_1.pointer, '\t', record_1.size);
+      if (!end) {
+        fprintf(stderr, "Error: A record has no tab.\n");
+        return 1;
+      }
+      record_2.pointer = end + 1;
+      record_2.size = record_1.size - (record_2.pointer - record_1.pointer);
+      record_1.size = end - record_1.pointer;
+      ret = stream_compare(stream_, &record_1, &record_2, 0, k);
+    }
+    if (ret) {
+      fprintf(stderr, "Error: Computation failed.\n");
+      return ret;
+    }
+    ++k;
+    start = next;
+  }
+  if (stream_->group->count) {
+    stream_run_group(stream_);
+  }
+
+  *used = start;
+  *count = k;
+  return 0;
+}
+
+int stream_run(char const delimiter,
+               buffer const * const reference,
+               FILE * const input) {
+  stream stream_;
+  char * block = NULL;
+  char * block_new = NULL;
+  size_t capacity = STREAM_BLOCK_SIZE;
+  size_t size = 0;
+  size_t read_ = 0;
+  size_t used = 0;
+  size_t count = 0;
+  size_t k = 0;
+  int is_final = 0;
+  int ret = 0;
+  STATS_TIMER(timer)
+
+  memset( &stream_, 0, sizeof(stream_) );
+  stream_.capacity = 1024;
+  stream_.distances = stats_calloc( stream_.capacity, sizeof(*stream_.distances) );
+  block = stats_malloc(capacity);
+  ret = !stream_.distances || !block ||
+        lane_group_create(&stream_.group);
+  if (!ret && reference) {
+    stream_.has_reference = 1;
+    stream_.reference.pointer = reference->pointer;
+    stream_.reference.size = reference->size;
+    if (reference->size > LANE_PATTERN_SIZE) {
+      ret = match_masks_create(reference->size,
+                               get_alphabet_size(reference->pointer, reference->size),
+                               &stream_.masks);
+      if (!ret) {
+        match_masks_fill(stream_.masks, reference->pointer, reference->size);
+      }
+    }
+  }
+  if (ret) {
+    fprintf(stderr, "Error: Could not allocate memory.\n");
+  }
+
+  while (!ret && !is_final) {
+    STATS_START(timer);
+    read_ = fread(block + size, 1, capacity - size, input);
+    STATS_STOP(timer, STATS_READ);
+    STATS_COUNT(STATS_BYTES_READ, read_);
+    size += read_;
+    if (size < capacity) {
+      if ( ferror(input) ) {
+        fprintf(stderr, "Error: Could not read records.\n");
+        ret = 1;
+        break;
+      }
+      is_final = 1;
+    }
+    ret = stream_block(&stream_, delimiter, block, size, is_final, &used, &count);
+    for (k = 0; !ret && k < count; ++k) {
+      ret = printf("%" SIZE_T_FORMAT "\n", stream_.distances[k]) < 0;
+    }
+    if ( !ret && fflush(stdout) ) {
+      ret = 1;
+    }
+    if (ret) {
+      break;
+    }
+    memmove(block, block + used, size - used);
+    size -= used;
+    if (size == capacity) {
+      /* A record does not fit into the block. */
+      block_new = NULL;
+      if ( !size_t_mul_aug(&capacity, 2) ) {
+        block_new = stats_realloc(block, capacity);
+      }
+      if (!block_new) {
+        fprintf(stderr, "Error: Could not allocate memory.\n");
+        ret = 1;
+        break;
+      }
+      block = block_new;
+    }
+  }
+
+  match_masks_destroy(stream_.masks);
+  lane_group_destroy(stream_.group);
+  free(stream_.distances);
+  free(block);
+  return ret;
+}
+
+
+
+/*  Searching approximately
+
+    search_run reports where the pattern occurs approximately in the text: for
+    each end offset e of the text, it prints "e d" if some substring of the text
+    that ends at e has the distance d <= k to the pattern, where d is the least
+    such distance. Gaps at both ends of the text are free, so the first row of
+    the dynamic programming is zero. The text is read in blocks of
+    STREAM_BLOCK_SIZE bytes. Only the words of a column up to the last active
+    one are computed (Ukkonen's cut-off, in the block form of Myers): below
+    it, all entries exceed k. scores[w] is the entry in the last row of the
+    word w.
+*/
+
+size_t get_word_size(size_t const pattern_size,
+                     size_t const w) {
+  return pattern_size - 64 * w < 64 ? pattern_size - 64 * w : 64;
+}
+
+int search_run(buffer const * const pattern,
+               size_t k,
+               FILE * const input) {
+  size_t const word_count = get_word_count(pattern->size);
+  size_t const last = word_count ? word_count - 1 : 0;
+  unsigned int const last_shift = (unsigned int)( (pattern->size + 63) % 64 );
+  match_masks * masks = NULL;
+  uint64_t * vp = NULL;
+  uint64_t * vn = NULL;
+  size_t * scores = NULL;
+  char * block = NULL;
+  uint64_t const * eqs = NULL;
+  uint64_t hp_in = 0;
+  uint64_t hn_in = 0;
+  size_t offset = 0;
+  size_t size = 0;
+  size_t y = 0; /* the last active word */
+  size_t i = 0;
+  size_t w = 0;
+  double cells = 0;
+  int ret = 0;
+  STATS_TIMER(timer)
+  STATS_TIMER(dp_timer)
+
+  if (k > pattern->size) {
+    k = pattern->size;
+  }
+  block = stats_malloc(STREAM_BLOCK_SIZE);
+  vp = stats_calloc( 2 * word_count + 1, sizeof(*vp) );
+  scores = stats_calloc( word_count + 1, sizeof(*scores) );
+  ret = !block || !vp || !scores ||
+        match_masks_create(pattern->size,
+                           get_alphabet_size(pattern->pointer, pattern->size),
+                           &masks);
+  if (ret) {
+    free(scores);
+    free(vp);
+    free(block);
+    fprintf(stderr, "Error: Could not allocate memory.\n");
+    return 1;
+  }
+  match_masks_fill(masks, pattern->pointer, pattern->size);
+  vn = vp + word_count;
+  for (w = 0; w < word_count; ++w) {
+    vp[w] = ~(uint64_t)0;
+    scores[w] = 64 * w + get_word_size(pattern->size, w);
+  }
+  y = minimum(k / 64, last);
+
+  if (pattern->size <= k) {
+    ret = printf("0 %" SIZE_T_FORMAT "\n", pattern->size) < 0;
+  }
+  while (!ret) {
+    STATS_START(timer);
+    size = fread(block, 1, STREAM_BLOCK_SIZE, input);
+    STATS_STOP(timer, STATS_READ);
+    STATS_COUNT(STATS_BYTES_READ, size);
+    STATS_START(dp_timer);
+    cells = 0;
+    for (i = 0; !ret && i < size && word_count; ++i) {
+      cells += (double)minimum( 64 * (y + 1), pattern->size );
+      eqs = masks->words +
+            masks->rows[*(unsigned char const *)(block + i)] * masks->stride;
+      hp_in = 0;
+      hn_in = 0;
+      for (w = 0; w <= y; ++w) {
+        bit_parallel_step(&vp[w], &vn[w], eqs[w], &hp_in, &hn_in,
+                          w == last ? last_shift : 63);
+        scores[w] += hp_in;
+        scores[w] -= hn_in;
+      }
+      if ( y < last && scores[y] + hn_in - hp_in <= k &&
+           ((eqs[y + 1] & 1) || hn_in) ) {
+        ++y;
+        vp[y] = ~(uint64_t)0;
+        vn[y] = 0;
+        scores[y] = scores[y - 1] + hn_in - hp_in + get_word_size(pattern->size, y);
+        bit_parallel_step(&vp[y], &vn[y], eqs[y], &hp_in, &hn_in,
+                          y == last ? last_shift : 63);
+        scores[y] += hp_in;
+        scores[y] -= hn_in;
+      }
+      else {
+        while (y && scores[y] >= k + get_word_size(pattern->size, y)) {
+          --y;
+        }
+      }
+      if (y == last && scores[y] <= k) {
+        ret = printf("%" SIZE_T_FORMAT " %" SIZE_T_FORMAT "\n", offset + i + 1, scores[y]) < 0;
+      }
+    }
+    STATS_STOP(dp_timer, STATS_DP);
+    STATS_COUNT(STATS_CELLS, cells);
+    /* The empty pattern occurs everywhere. */
+    for (i = 0; !ret && i < size && !word_count; ++i) {
+      ret = printf("%" SIZE_T_FORMAT " 0\n", offset + i + 1) < 0;
+    }
+    offset += size;
+    if (size < STREAM_BLOCK_SIZE) {
+      break;
+    }
+  }
+  if ( !ret && ferror(input) ) {
+    fprintf(stderr, "Error: Could not read text.\n");
+    ret = 1;
+  }
+
+  match_masks_destroy(masks);
+  free(scores);
+  free(vp);
+  free(block);
+  return ret;
+}
+
+
+
+/*  Estimating by sampling
+
+    sample_run estimates the Levenshtein distance of two bytestrings that are
+    too large to compare. The longer bytestring is split into ESTIMATE_SAMPLES
+    strata of equal size, and a window of up to ESTIMATE_WINDOW bytes is drawn
+    from each stratum at a pseudorandom offset (seeded by the hashes, so that
+    the estimate is reproducible). The window at offset p is compared with the
+    region of the shorter bytestring around the offset that corresponds to p
+    in proportion to the sizes; the region extends a quarter of a window beyond
+    both ends, and gaps at both ends of the region are free. Thus, a window
+    that the edits before it have shifted finds its counterpart again (local
+    resynchronization); for unrelated bytestrings, the free gaps make the
+    estimate a few percent too low. The samples are compared in parallel.
+    The estimate extrapolates the mean distance of the windows to the size of
+    the longer bytestring; the interval is the approximate 95% confidence
+    interval of the mean (mean +- 1.96 standard errors), extrapolated alike.
+    Both are clamped to the bounds of get_ld_lb and get_ld_ub. Bytestrings of
+    up to ESTIMATE_EXACT_SIZE bytes are compared exactly instead.
+*/
+
+#define ESTIMATE_SAMPLES 64
+#define ESTIMATE_WINDOW 4096
+#define ESTIMATE_EXACT_SIZE ((size_t)1 << 16)
+
+typedef struct {
+  buffer const * longer;
+  buffer const * shorter;
+  size_t stratum_size;
+  size_t window_size;
+  uint64_t seed;
+  size_t distances[ESTIMATE_SAMPLES];
+} sample_context;
+
+/*  get_local_distance returns the least distance between the pattern of the
+    masks and a substring of the text.
+*/
+
+size_t get_local_distance(match_masks const * const masks,
+                          char const * const text,
+                          size_t const text_size) {
+  size_t const word_count = get_word_count(masks->size);
+  unsigned int const last_shift = (unsigned int)( (masks->size + 63) % 64 );
+  uint64_t vp[ESTIMATE_WINDOW / 64];
+  uint64_t vn[ESTIMATE_WINDOW / 64];
+  uint64_t const * eqs = NULL;
+  uint64_t hp_in = 0;
+  uint64_t hn_in = 0;
+  size_t score = masks->size;
+  size_t best = masks->size;
+  size_t i = 0;
+  size_t w = 0;
+
+  assert(word_count <= ESTIMATE_WINDOW / 64);
+  for (w = 0; w < word_count; ++w) {
+    vp[w] = ~(uint64_t)0;
+    vn[w] = 0;
+  }
+  for (i = 0; i < text_size && word_count; ++i) {
+    eqs = masks->words +
+          masks->rows[*(unsigned char const *)(text + i)] * masks->stride;
+    hp_in = 0;
+    hn_in = 0;
+    for (w = 0; w < word_count; ++w) {
+      bit_parallel_step(&vp[w], &vn[w], eqs[w], &hp_in, &hn_in,
+                        w + 1 == word_count ? last_shift : 63);
+    }
+    score += hp_in;
+    score -= hn_in;
+    if (best > score) {
+      best = score;
+    }
+  }
+  return best;
+}
+
+int sample_compute(void * const context_, size_t const index) {
+  sample_context * const context = context_;
+  buffer const * const longer = context->longer;
+  buffer const * const shorter = context->shorter;
+  size_t const window_size = context->window_size;
+  size_t const slack = window_size / 4;
+  char const * const window = longer->pointer + index * context->stratum_size +
+    uint64_fmix(context->seed + index) %
+      (context->stratum_size - window_size + 1);
+  size_t const offset = (size_t)( (double)(window - longer->pointer) *
+                                  shorter->size / longer->size );
+  size_t const extent = (size_t)( (double)window_size *
+                                  shorter->size / longer->size );
+  size_t const begin = offset > slack ? offset - slack : 0;
+  size_t const end = minimum(offset + extent + slack, shorter->size);
+  match_masks * masks = NULL;
+  int ret = 0;
+
+  ret = match_masks_create(window_size,
+                           get_alphabet_size(window, window_size),
+                           &masks);
+  if (ret) {
+    return ret;
+  }
+  match_masks_fill(masks, window, window_size);
+  context->distances[index] = get_local_distance(masks, shorter->pointer + begin,
+                                                 end - begin);
+  match_masks_destroy(masks);
+  return 0;
+}
+
+int sample_run(buffer const * const buffer_1,
+               buffer const * const buffer_2,
+               size_t const thread_count) {
+  sample_context * context = NULL;
+  size_t bounds[2] = {0, 0};
+  size_t estimate = 0;
+  size_t low = 0;
+  size_t high = 0;
+  size_t sum = 0;
+  double mean = 0;
+  double variance = 0;
+  double scale = 0;
+  double half_width = 0;
+  size_t i = 0;
+  int ret = 0;
+
+  ret = get_ld_lb('l', buffer_1, buffer_2, &bounds[0]) ||
+        get_ld_ub(buffer_1, buffer_2, &bounds[1]);
+  if (ret) {
+    fprintf(stderr, "Error: Computation failed.\n");
+    return ret;
+  }
+
+  if ( maximum(buffer_1->size, buffer_2->size) <= ESTIMATE_EXACT_SIZE ) {
+    ret = get_levenshtein_distance_bit_parallel(buffer_1, buffer_2, &estimate);
+    if (ret) {
+      fprintf(stderr, "Error: Computation failed.\n");
+      return ret;
+    }
+    low = estimate;
+    high = estimate;
+  }
+  else {
+    context = stats_calloc( 1, sizeof(*context) );
+    if (!context) {
+      fprintf(stderr, "Error: Could not allocate memory.\n");
+      return 1;
+    }
+    context->longer = buffer_1->size >= buffer_2->size ? buffer_1 : buffer_2;
+    context->shorter = buffer_1->size >= buffer_2->size ? buffer_2 : buffer_1;
+    context->stratum_size = context->longer->size / ESTIMATE_SAMPLES;
+    context->window_size = minimum(context->stratum_size, ESTIMATE_WINDOW);
+    context->seed = buffer_1->hash[0] ^ buffer_2->hash[1];
+    ret = parallel_for(ESTIMATE_SAMPLES, thread_count, sample_compute, context);
+    if (ret) {
+      free(context);
+      fprintf(stderr, "Error: Computation failed.\n");
+      return ret;
+    }
+    for (i = 0; i < ESTIMATE_SAMPLES; ++i) {
+      sum += context->distances[i];
+    }
+    mean = (double)sum / ESTIMATE_SAMPLES;
+    for (i = 0; i < ESTIMATE_SAMPLES; ++i) {
+      variance += (context->distances[i] - mean) * (context->distances[i] - mean);
+    }
+    variance /= ESTIMATE_SAMPLES - 1;
+    scale = (double)context->longer->size / context->window_size;
+    half_width = 1.96 * scale *
+                 get_square_root( (size_t)(variance / ESTIMATE_SAMPLES * 10000) ) /
+                 100;
+    estimate = (size_t)(mean * scale + 0.5);
+    low = mean * scale > half_width ? (size_t)(mean * scale - half_width) : 0;
+    high = (size_t)(mean * scale + half_width + 0.5);
+    free(context);
+  }
+
+  estimate = minimum(maximum(estimate, bounds[0]), bounds[1]);
+  low = minimum(maximum(low, bounds[0]), bounds[1]);
+  high = minimum(maximum(high, bounds[0]), bounds[1]);
+  ret = printf("%" SIZE_T_FORMAT " %" SIZE_T_FORMAT " %" SIZE_T_FORMAT
+               " %" SIZE_T_FORMAT " %" SIZE_T_FORMAT "\n",
+               estimate, low, high, bounds[0], bounds[1]) < 0;
+  return ret;
+}
+
+
+
+/*  Comparing directory trees
+
+    tree_run walks two directory trees and matches their regular files by
+    relative path; then, it computes the results for the matched pairs in
+    parallel. A file that occurs in one tree only is compared with the empty
+    bytestring. Pairs that refer to the same inode are skipped without reading
+    them. The sizes from the listing decide the rest before any file is read:
+    pairs of different sizes are different; pairs of equal sizes are compared
+    block by block, without buffering, and skipped if they agree. The
+    report lists one line "result status path" per path, by descending result.
+    The status is '=' (identical), '~' (different), '-' (only in the first
+    tree) or '+' (only in the second tree).
+*/
+
+#ifdef __linux__
+
+typedef struct {
+  char * path; /* relative to the root of the tree */
+  size_t size;
+  dev_t device;
+  ino_t inode;
+} tree_file;
+
+typedef struct {
+  tree_file * files;
+  size_t count;
+  size_t capacity;
+} tree_listing;
+
+typedef struct {
+  tree_file const * file_1; /* NULL if the path only occurs in the second tree */
+  tree_file const * file_2; /* NULL if the path only occurs in the first tree */
+  size_t result;
+  char status;
+} tree_entry;
+
+typedef struct {
+  char const * root_1;
+  char const * root_2;
+  measure measure_;
+  size_t max_size;
+  cache * cache_;
+  tree_entry * entries;
+} tree_context;
+
+char * path_join(char const * const path_1,
+                 char const * const path_2) {
+  size_t const length_1 = strlen(path_1);
+  size_t const length_2 = strlen(path_2);
+  char * path = NULL;
+
+  path = stats_malloc(length_1 + length_2 + 2);
+  if (!path) {
+    return NULL;
+  }
+  memcpy(path, path_1, length_1);
+  path[length_1] = '/';
+  memcpy(path + length_1 + 1, path_2, length_2 + 1);
+  return path;
+}
+
+void tree_listing_destroy(tree_listing * const listing) {
+  size_t i = 0;
+
+  for (i = 0; i < listing->count; ++i) {
+    free(listing->files[i].path);
+  }
+  free(listing->files);
+  listing->files = NULL;
+  listing->count = 0;
+  listing->capacity = 0;
+}
+
+int tree_listing_walk(tree_listing * const listing,
+                      char const * const root,
+                      char const * const relative) {
+  DIR * directory = NULL;
+  struct dirent * entry = NULL;
+  struct stat status;
+  char * directory_path = NULL;
+  char * child_relative = NULL;
+  char * child_path = NULL;
+  tree_file * files = NULL;
+  int ret = 0;
+
+  directory_path = *relative ? path_join(root, relative) : string_copy(root);
+  if (!directory_path) {
+    return 1;
+  }
+  directory = opendir(directory_path);
+  free(directory_path);
+  if (!directory) {
+    return 1;
+  }
+
+  while ( !ret && (entry = readdir(directory)) ) {
+    if ( !strcmp(entry->d_name, ".") ||
+         !strcmp(entry->d_name, "..") ) {
+      continue;
+    }
+    child_relative = *relative ? path_join(relative, entry->d_name) : string_copy(entry->d_name);
+    child_path = child_relative ? path_join(root, child_relative) : NULL;
+    if (!child_path) {
+      free(child_relative);
+      ret = 1;
+      break;
+    }
+    if ( lstat(child_path, &status) ) {
+      ret = 1;
+    }
+    else if ( S_ISDIR(status.st_mode) ) {
+      ret = tree_listing_walk(listing, root, child_relative);
+    }
+    else if ( S_ISREG(status.st_mode) ) {
+      if (listing->count == listing->capacity) {
+        listing->capacity = listing->capacity ? 2 * listing->capacity : 256;
+        files = stats_realloc( listing->files, listing->capacity * sizeof(*files) );
+        if (!files) {
+          ret = 1;
+        }
+        else {
+          listing->files = files;
+        }
+      }
+      if (!ret) {
+        listing->files[listing->count].path = child_relative;
+        listing->files[listing->count].size = (size_t)status.st_size;
+        listing->files[listing->count].device = status.st_dev;
+        listing->files[listing->count].inode = status.st_ino;
+        ++listing->count;
+        child_relative = NULL;
+      }
+    }
+    if (ret) {
+      fprintf(stderr, "Error: Could not read %s.\n", child_path);
+    }
+    free(child_path);
+    free(child_relative);
+  }
+
+  closedir(directory);
+  return ret;
+}
+
+int tree_file_compare(void const * const op1,
+                      void const * const op2) {
+  return strcmp( ((tree_file const *)op1)->path,
+                 ((tree_file const *)op2)->path );
+}
+
+char const * tree_entry_path(tree_entry const * const entry) {
+  return entry->file_1 ? entry->file_1->path : entry->file_2->path;
+}
+
+int tree_entry_compare(void const * const op1,
+                       void const * const op2) {
+  tree_entry const * const entry_1 = op1;
+  tree_entry const * const entry_2 = op2;
+
+  if (entry_1->result != entry_2->result) {
+    return entry_1->result > entry_2->result ? -1 : 1;
+  }
+  return strcmp( tree_entry_path(entry_1), tree_entry_path(entry_2) );
+}
+
+#define TREE_BLOCK_SIZE 65536
+
+/*  tree_files_equal compares the first size bytes of both files, a block at a
+    time; it stops at the first block that differs. A file that has become
+    shorter since the listing differs.
+*/
+
+int tree_files_equal(char const * const path_1,
+                     char const * const path_2,
+                     size_t size,
+                     int * const equal) {
+  char block_1[TREE_BLOCK_SIZE];
+  char block_2[TREE_BLOCK_SIZE];
+  FILE * file_1 = NULL;
+  FILE * file_2 = NULL;
+  size_t t = 0;
+  int ret = 0;
+
+  file_1 = fopen(path_1, "rb");
+  file_2 = fopen(path_2, "rb");
+  ret = !file_1 || !file_2;
+  *equal = 1;
+  while (!ret && *equal && size) {
+    t = minimum(size, TREE_BLOCK_SIZE);
+    *equal = fread(block_1, 1, t, file_1) == t &&
+             fread(block_2, 1, t, file_2) == t &&
+             !memcmp(block_1, block_2, t);
+    size -= t;
+  }
+  if (file_2) {
+    fclose(file_2);
+  }
+  if (file_1) {
+    fclose(file_1);
+  }
+  return ret;
+}
+
+int tree_entry_compute(void * const context_, size_t const index) {
+  tree_context const * const context = context_;
+  tree_entry * const entry = &context->entries[index];
+  buffer * buffer_1 = NULL;
+  buffer * buffer_2 = NULL;
+  char * path_1 = NULL;
+  char * path_2 = NULL;
+  size_t const size_1 = minimum(entry->file_1 ? entry->file_1->size : 0,
+                                context->max_size);
+  size_t const size_2 = minimum(entry->file_2 ? entry->file_2->size : 0,
+                                context->max_size);
+  int equal = 0;
+  int ret = 0;
+
+  if (!entry->file_1 || !entry->file_2) {
+    entry->status = entry->file_1 ? '-' : '+';
+    entry->result = minimum( entry->file_1 ? entry->file_1->size : entry->file_2->size,
+                             context->max_size );
+    return 0;
+  }
+  if (entry->file_1->device == entry->file_2->device &&
+      entry->file_1->inode == entry->file_2->inode) {
+    entry->status = '=';
+    entry->result = 0;
+    return 0;
+  }
+
+  path_1 = path_join(context->root_1, entry->file_1->path);
+  path_2 = path_join(context->root_2, entry->file_2->path);
+  ret = !path_1 || !path_2;
+  if (!ret && size_1 == size_2) {
+    ret = tree_files_equal(path_1, path_2, size_1, &equal);
+  }
+  if (!ret && !equal) {
+    ret = buffer_create(path_1, context->max_size, &buffer_1) ||
+          buffer_create(path_2, context->max_size, &buffer_2);
+  }
+  free(path_2);
+  free(path_1);
+  if (ret) {
+    fprintf(stderr, "Error: Could not read %s.\n", entry->file_1->path);
+  }
+  else if (equal) {
+    entry->status = '=';
+    entry->result = 0;
+  }
+  else {
+    entry->status = '~';
+    ret = get_cached_result(context->cache_, &context->measure_,
+                            buffer_1, buffer_2, &entry->result);
+    if (ret) {
+      fprintf(stderr, "Error: Computation failed for %s.\n", entry->file_1->path);
+    }
+  }
+  buffer_destroy(buffer_2);
+  buffer_destroy(buffer_1);
+  return ret;
+}
+
+int tree_run(measure const * const measure_,
+             char const * const root_1,
+             char const * const root_2,
+             size_t const max_size,
+             size_t const thread_count,
+             cache * const cache_) {
+  tree_listing listing_1 = {0};
+  tree_listing listing_2 = {0};
+  tree_context context;
+  size_t count = 0;
+  size_t i = 0;
+  size_t j = 0;
+  int ret = 0;
+  int order = 0;
+
+  ret = tree_listing_walk(&listing_1, root_1, "");
+  if (!ret) {
+    ret = tree_listing_walk(&listing_2, root_2, "");
+  }
+  if (ret) {
+    fprintf(stderr, "Error: Could not walk the directory trees.\n");
+    tree_listing_destroy(&listing_2);
+    tree_listing_destroy(&listing_1);
+    return ret;
+  }
+  qsort( listing_1.files, listing_1.count, sizeof(*listing_1.files), tree_file_compare );
+  qsort( listing_2.files, listing_2.count, sizeof(*listing_2.files), tree_file_compare );
+
+  memset( &context, 0, sizeof(context) );
+  context.root_1 = root_1;
+  context.root_2 = root_2;
+  context.measure_ = *measure_;
+  context.max_size = max_size;
+  context.cache_ = cache_;
+  context.entries = stats_calloc( listing_1.count + listing_2.count + 1,
+                                  sizeof(*context.entries) );
+  if (!context.entries) {
+    tree_listing_destroy(&listing_2);
+    tree_listing_destroy(&listing_1);
+    return 1;
+  }
+  while (i < listing_1.count || j < listing_2.count) {
+    if (i == listing_1.count) {
+      order = 1;
+    }
+    else if (j == listing_2.count) {
+      order = -1;
+    }
+    else {
+      order = strcmp(listing_1.files[i].path, listing_2.files[j].path);
+    }
+    if (order <= 0) {
+      context.entries[count].file_1 = &listing_1.files[i++];
+    }
+    if (order >= 0) {
+      context.entries[count].file_2 = &listing_2.files[j++];
+    }
+    ++count;
+  }
+
+  ret = parallel_for(count, thread_count, tree_entry_compute, &context);
+  if (!ret) {
+    qsort( context.entries, count, sizeof(*context.entries), tree_entry_compare );
+    for (i = 0; !ret && i < count; ++i) {
+      ret = printf("%" SIZE_T_FORMAT " %c %s\n",
+                   context.entries[i].result,
+                   context.entries[i].status,
+                   tree_entry_path(&context.entries[i])) < 0;
+    }
+  }
+
+  free(context.entries);
+  tree_listing_destroy(&listing_2);
+  tree_listing_destroy(&listing_1);
+  return ret;
+}
+
+#endif /* __linux__ */
+
+
+
+/*  Watching a directory
+
+    watch_run keeps an index of the regular files in a directory: their
+    contents, hashes, byte histograms and sketches. It subscribes to inotify;
+    whenever a file is written or moved into the directory, only that file is
+    read again, and it is compared with each other file of the index. The
+    comparison uses the lower bound from the histograms and sketches (see
+    get_lb_from_summaries) as a filter; only the remaining pairs
+    are computed, by the planner, which may stop after threshold edits. Each
+    pair within the threshold is reported as a line
+    "changed_file other_file distance". If inotify loses events, the
+    directory is scanned again, and only the files whose size or modification
+    time changed are read again.
+*/
+
+#ifdef __linux__
+
+typedef struct {
+  char * name;
+  buffer * buffer_;
+  size_t histogram[256];
+  size_t * sketch; /* SKETCH_BINS counts, for the metrics 'l' and 'o' */
+  off_t file_size;
+  struct timespec modified;
+  int seen; /* whether the last scan found the file unchanged */
+} watch_entry;
+
+typedef struct {
+  char const * directory;
+  size_t threshold;
+  size_t max_size;
+  measure distance_measure;
+  watch_entry * entries;
+  size_t count;
+  size_t capacity;
+} watch_index;
+
+int watch_entry_compare(void const * const op1,
+                        void const * const op2) {
+  return strcmp( (*(watch_entry * const *)op1)->name,
+                 (*(watch_entry * const *)op2)->name );
+}
+
+void watch_index_remove_at(watch_index * const index,
+                           size_t const i) {
+  free(index->entries[i].name);
+  free(index->entries[i].sketch);
+  buffer_destroy(index->entries[i].buffer_);
+  index->entries[i] = index->entries[--index->count];
+}
+
+void watch_index_remove(watch_index * const index,
+                        char const * const name) {
+  size_t i = 0;
+
+  for (i = 0; i < index->count; ++i) {
+    if ( !strcmp(index->entries[i].name, name) ) {
+      watch_index_remove_at(index, i);
+      return;
+    }
+  }
+}
+
+/*  watch_index_update (re)reads the file with the given name. If alert is
+    set, it reports the near duplicates of the file. Unless replace is set,
+    the caller knows that the name is not in the index.
+*/
+
+int watch_index_update(watch_index * const index,
+                       char const * const name,
+                       int const alert,
+                       int const replace) {
+  watch_entry entry;
+  watch_entry * entries = NULL;
+  struct stat status;
+  char * path = NULL;
+  size_t bound = 0;
+  size_t i = 0;
+  int ret = 0;
+
+  memset( &entry, 0, sizeof(entry) );
+  if (replace) {
+    watch_index_remove(index, name);
+  }
+  path = path_join(index->directory, name);
+  if (!path) {
+    return 1;
+  }
+  if ( lstat(path, &status) || !S_ISREG(status.st_mode) ) {
+    free(path);
+    return 0; /* The file is gone, or it is not a regular file. */
+  }
+  ret = buffer_create(path, index->max_size, &entry.buffer_);
+  free(path);
+  if (ret) {
+    fprintf(stderr, "Warning: Could not read %s.\n", name);
+    return 0;
+  }
+  entry.name = string_copy(name);
+  if ( entry.name &&
+       (index->distance_measure.metric == 'l' ||
+        index->distance_measure.metric == 'o') ) {
+    entry.sketch = stats_malloc( SKETCH_BINS * sizeof(*entry.sketch) );
+    if (entry.sketch) {
+      get_sketch(entry.buffer_, entry.sketch);
+    }
+    else {
+      free(entry.name);
+      entry.name = NULL;
+    }
+  }
+  if (!entry.name) {
+    buffer_destroy(entry.buffer_);
+    return 1;
+  }
+  entry.file_size = status.st_size;
+  entry.modified = status.st_mtim;
+  get_histogram(entry.buffer_, entry.histogram);
+
+  for (i = 0; alert && i < index->count; ++i) {
+    ret = get_lb_from_summaries(&index->distance_measure,
+                                entry.histogram, entry.sketch,
+                                entry.buffer_->size,
+                                index->entries[i].histogram,
+                                index->entries[i].sketch,
+                                index->entries[i].buffer_->size,
+                                &bound);
+    if (!ret && bound <= index->threshold) {
+      if (index->distance_measure.metric == 'w') {
+        ret = get_result(&index->distance_measure, entry.buffer_,
+                         index->entries[i].buffer_, &bound);
+      }
+      else {
+        ret = get_planned_distance(index->distance_measure.metric,
+                                   index->distance_measure.calibration_,
+                                   index->distance_measure.max_memory,
+                                   entry.buffer_, index->entries[i].buffer_,
+                                   index->threshold, NULL, &bound);
+      }
+      if (!ret && bound <= index->threshold) {
+        ret = printf("%s %s %" SIZE_T_FORMAT "\n",
+                     entry.name, index->entries[i].name, bound) < 0;
+      }
+    }
+    if (ret) {
+      break;
+    }
+  }
+  if (!ret && alert) {
+    ret = fflush(stdout) != 0;
+  }
+
+  if (!ret && index->count == index->capacity) {
+    index->capacity = index->capacity ? 2 * index->capacity : 64;
+    entries = stats_realloc( index->entries, index->capacity * sizeof(*entries) );
+    if (!entries) {
+      ret = 1;
+    }
+    else {
+      index->entries = entries;
+    }
+  }
+  if (ret) {
+    free(entry.name);
+    free(entry.sketch);
+    buffer_destroy(entry.buffer_);
+    return ret;
+  }
+  index->entries[index->count++] = entry;
+  return 0;
+}
+
+/*  watch_index_scan brings the index up to date with the directory: the
+    entries of files that are gone or changed are removed, and the changed
+    and the new files are read (and reported, if alert is set). The entries
+    are looked up by name in a sorted copy of the index, so that a scan takes
+    O(n log n) comparisons.
+*/
+
+int watch_index_scan(watch_index * const index,
+                     int const alert) {
+  watch_entry ** sorted = NULL;
+  watch_entry ** found = NULL;
+  watch_entry key;
+  watch_entry * key_pointer = &key;
+  char ** names = NULL;
+  char ** more_names = NULL;
+  size_t name_count = 0;
+  size_t name_capacity = 0;
+  DIR * dir = NULL;
+  struct dirent * dirent_ = NULL;
+  struct stat status;
+  char * path = NULL;
+  size_t i = 0;
+  int ret = 0;
+
+  memset( &key, 0, sizeof(key) );
+  if (index->count) {
+    sorted = stats_malloc( index->count * sizeof(*sorted) );
+    if (!sorted) {
+      return 1;
+    }
+    for (i = 0; i < index->count; ++i) {
+      index->entries[i].seen = 0;
+      sorted[i] = &index->entries[i];
+    }
+    qsort( sorted, index->count, sizeof(*sorted), watch_entry_compare );
+  }
+  dir = opendir(index->directory);
+  if (!dir) {
+    fprintf(stderr, "Error: Could not read %s.\n", index->directory);
+    free(sorted);
+    return 1;
+  }
+  while ( !ret && (dirent_ = readdir(dir)) ) {
+    if ( !strcmp(dirent_->d_name, ".") ||
+         !strcmp(dirent_->d_name, "..") ) {
+      continue;
+    }
+    key.name = dirent_->d_name;
+    found = sorted ? bsearch( &key_pointer, sorted, index->count, sizeof(*sorted),
+                              watch_entry_compare ) : NULL;
+    if (found) {
+      path = path_join(index->directory, dirent_->d_name);
+      if (!path) {
+        ret = 1;
+        break;
+      }
+      if ( !lstat(path, &status) && S_ISREG(status.st_mode) &&
+           status.st_size == (*found)->file_size &&
+           status.st_mtim.tv_sec == (*found)->modified.tv_sec &&
+           status.st_mtim.tv_nsec == (*found)->modified.tv_nsec ) {
+        (*found)->seen = 1;
+      }
+      free(path);
+      if ( (*found)->seen ) {
+        continue;
+      }
+    }
+    if (name_count == name_capacity) {
+      name_capacity = name_capacity ? 2 * name_capacity : 64;
+      more_names = stats_realloc( names, name_capacity * sizeof(*names) );
+      if (!more_names) {
+        ret = 1;
+        break;
+      }
+      names = more_names;
+    }
+    names[name_count] = string_copy(dirent_->d_name);
+    if (!names[name_count]) {
+      ret = 1;
+      break;
+    }
+    ++name_count;
+  }
+  closedir(dir);
+  free(sorted);
+
+  for (i = index->count; !ret && i-- > 0; ) {
+    if (!index->entries[i].seen) {
+      watch_index_remove_at(index, i);
+    }
+  }
+  for (i = 0; !ret && i < name_count; ++i) {
+    ret = watch_index_update(index, names[i], alert, 0);
+  }
+  for (i = 0; i < name_count; ++i) {
+    free(names[i]);
+  }
+  free(names);
+  return ret;
+}
+
+int watch_run(char const * const directory,
+              size_t const threshold,
+              size_t const max_size,
+              measure const * const measure_) {
+  watch_index index;
+  struct inotify_event const * event = NULL;
+  union {
+    struct inotify_event event;
+    char bytes[4096];
+  } events;
+  ssize_t length = 0;
+  char * position = NULL;
+  int fd = -1;
+  int ret = 0;
+
+  memset( &index, 0, sizeof(index) );
+  index.directory = directory;
+  index.threshold = threshold;
+  index.max_size = max_size;
+  index.distance_measure = *measure_;
+  index.distance_measure.option = 'd';
+
+  /* Subscribe before the initial scan, so that no change goes unnoticed. */
+  fd = inotify_init1(IN_CLOEXEC);
+  if ( fd < 0 ||
+       inotify_add_watch(fd, directory,
+                         IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE) < 0 ) {
+    fprintf(stderr, "Error: Could not watch %s.\n", directory);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return 1;
+  }
+  ret = watch_index_scan(&index, 0);
+  if (!ret) {
+    fprintf(stderr, "Watching %" SIZE_T_FORMAT " files in %s.\n", index.count, directory);
+  }
+
+  while (!ret) {
+    length = read(fd, events.bytes, sizeof(events.bytes));
+    if (length < 0 && errno == EINTR) {
+      continue;
+    }
+    if (length <= 0) {
+      ret = 1;
+      break;
+    }
+    for (position = events.bytes; !ret && position < events.bytes + length;
+         position += sizeof(struct inotify_event) + event->len) {
+      event = (struct inotify_event const *)position;
+      if (event->mask & IN_Q_OVERFLOW) {
+        fprintf(stderr, "Warning: Events were lost; scanning %s again.\n",
+                directory);
+        ret = watch_index_scan(&index, 1);
+        continue;
+      }
+      if ( !event->len ||
+           event->mask & IN_ISDIR ) {
+        continue;
+      }
+      if ( event->mask & (IN_DELETE | IN_MOVED_FROM) ) {
+        watch_index_remove(&index, event->name);
+      }
+      else {
+        ret = watch_index_update(&index, event->name, 1, 1);
+      }
+    }
+  }
+
+  while (index.count) {
+    watch_index_remove_at(&index, index.count - 1);
+  }
+  free(index.entries);
+  close(fd);
+  return ret;
+}
+
+#endif /* __linux__ */
+
+
+
+/*  Daemon mode
+
+    A daemon keeps a corpus resident and serves requests on a Unix domain
+    socket. Requests and responses are fixed-size records in native byte
+    order:
+      - A request (daemon_request) asks for a distance or a bound between two
+        files of the corpus ('d', 'l', 'u'), for the k nearest neighbours of a
+        file ('k'), or for the daemon to quit ('q').
+      - A response (daemon_response) echoes the id of its request, and it is
+        followed by count results (daemon_result).
+    Responses of a connection may arrive in a different order than their
+    requests. A single thread runs an event loop (epoll) over the sockets and
+    hands the computations to a thread pool; the pool reports finished jobs
+    through an eventfd.
+*/
+
+typedef struct {
+  uint32_t id;
+  uint32_t option;
+  uint32_t index_1;
+  uint32_t index_2; /* option 'k': the number of neighbours */
+} daemon_request;
+
+typedef struct {
+  uint32_t id;
+  uint32_t status; /* 0 if and only if the request succeeded */
+  uint32_t count;
+  uint32_t reserved;
+} daemon_response;
+
+typedef struct {
+  uint64_t index;
+  uint64_t value;
+} daemon_result;
+
+#if defined(__linux__) && !defined(NO_THREADS)
+
+typedef struct daemon_connection {
+  int fd;
+  int closed;
+  size_t pending; /* the number of jobs in the pool */
+  unsigned char input[sizeof(daemon_request)];
+  size_t input_size;
+  unsigned char * output;
+  size_t output_size;
+  size_t output_capacity;
+  struct daemon_connection * next;
+} daemon_connection;
+
+struct daemon_state;
+
+typedef struct daemon_job {
+  pool_task task; /* This must be the first member. */
+  struct daemon_state * daemon_;
+  daemon_connection * connection;
+  daemon_request request;
+  daemon_response response;
+  candidate * results;
+  struct daemon_job * next;
+} daemon_job;
+
+typedef struct daemon_state {
+  corpus * corpus_;
+  measure measure_; /* the option is set by each request */
+  pool * pool_;
+  int listen_fd;
+  int event_fd;
+  int epoll_fd;
+  int stopping;
+  pthread_mutex_t mutex;
+  daemon_job * done; /* protected by the mutex */
+  daemon_connection * connections;
+} daemon_state;
+
+void daemon_job_run(pool_task * const task) {
+  daemon_job * const job = (daemon_job *)task;
+  corpus const * const corp = job->daemon_->corpus_;
+  daemon_request const * const request = &job->request;
+  measure measure_;
+  size_t count = 0;
+  uint64_t one = 1;
+  int ret = 0;
+
+  job->response.id = request->id;
+  job->response.status = 1;
+  job->response.count = 0;
+  if ( request->index_1 < corp->list->count &&
+       (request->option == 'k' || request->index_2 < corp->list->count) ) {
+    if (request->option == 'k') {
+      count = minimum(request->index_2, corp->list->count);
+      job->results = stats_calloc( count + 1, sizeof(*job->results) );
+      if (job->results) {
+        ret = get_top_k(corp, &job->daemon_->measure_, request->index_1, count,
+                        job->results, &count);
+        if (!ret) {
+          job->response.status = 0;
+          job->response.count = (uint32_t)count;
+        }
+      }
+    }
+    else if ( request->option == 'd' ||
+              request->option == 'l' ||
+              request->option == 'u' ) {
+      measure_ = job->daemon_->measure_;
+      measure_.option = (char)request->option;
+      job->results = stats_calloc( 1, sizeof(*job->results) );
+      if (job->results) {
+        job->results->index = request->index_2;
+        ret = corpus_get_result(corp, &measure_,
+                                request->index_1, request->index_2,
+                                &job->results->bound);
+        if (!ret) {
+          job->response.status = 0;
+          job->response.count = 1;
+        }
+      }
+    }
+  }
+
+  pthread_mutex_lock(&job->daemon_->mutex);
+  job->next = job->daemon_->done;
+  job->daemon_->done = job;
+  pthread_mutex_unlock(&job->daemon_->mutex);
+  if ( sizeof(one) != write(job->daemon_->event_fd, &one, sizeof(one)) ) {
+    /* The counter of an eventfd only fails to grow at its maximum, at which
+       point the event loop is going to wake up anyway. */
+  }
+}
+
+void daemon_job_destroy(daemon_job * const job) {
+  if (job) {
+    free(job->results);
+  }
+  free(job);
+}
+
+int daemon_connection_append(daemon_connection * const connection,
+                             void const * const data,
+                             size_t const size) {
+  size_t capacity = connection->output_capacity;
+  unsigned char * output = NULL;
+
+  if (connection->output_capacity - connection->output_size < size) {
+    if ( size_t_add(&capacity, connection->output_size, size) ||
+         size_t_mul_aug(&capacity, 2) ) {
+      return 1;
+    }
+    output = stats_realloc(connection->output, capacity);
+    if (!output) {
+      return 1;
+    }
+    connection->output = output;
+    connection->output_capacity = capacity;
+  }
+  memcpy(connection->output + connection->output_size, data, size);
+  connection->output_size += size;
+  return 0;
+}
+
+void daemon_connection_close(daemon_state * const daemon_,
+                             daemon_connection * const connection) {
+  if (!connection->closed) {
+    epoll_ctl(daemon_->epoll_fd, EPOLL_CTL_DEL, connection->fd, NULL);
+    close(connection->fd);
+    connection->closed = 1;
+  }
+}
+
+void daemon_connection_flush(daemon_state * const daemon_,
+                             daemon_connection * const connection) {
+  struct epoll_event event = {0};
+  ssize_t sent = 0;
+
+  while (!connection->closed && connection->output_size) {
+    sent = send(connection->fd, connection->output, connection->output_size,
+                MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        daemon_connection_close(daemon_, connection);
+        return;
+      }
+      break;
+    }
+    memmove(connection->output, connection->output + sent,
+            connection->output_size - (size_t)sent);
+    connection->output_size -= (size_t)sent;
+  }
+  if (!connection->closed) {
+    event.events = EPOLLIN | (connection->output_size ? EPOLLOUT : 0);
+    event.data.ptr = connection;
+    epoll_ctl(daemon_->epoll_fd, EPOLL_CTL_MOD, connection->fd, &event);
+  }
+}
+
+void daemon_complete(daemon_state * const daemon_) {
+  daemon_job * job = NULL;
+  daemon_job * next = NULL;
+  daemon_connection * connection = NULL;
+  daemon_result result = {0};
+  uint64_t counter = 0;
+  size_t i = 0;
+
+  if ( sizeof(counter) != read(daemon_->event_fd, &counter, sizeof(counter)) ) {
+    /* Nothing is lost; the done list is checked regardless. */
+  }
+  pthread_mutex_lock(&daemon_->mutex);
+  job = daemon_->done;
+  daemon_->done = NULL;
+  pthread_mutex_unlock(&daemon_->mutex);
+
+  for (; job; job = next) {
+    next = job->next;
+    connection = job->connection;
+    --connection->pending;
+    if (!connection->closed) {
+      int ret = daemon_connection_append(connection, &job->response, sizeof(job->response));
+      for (i = 0; !ret && i < job->response.count; ++i) {
+        result.index = job->results[i].index;
+        result.value = job->results[i].bound;
+        ret = daemon_connection_append(connection, &result, sizeof(result));
+      }
+      if (ret) {
+        daemon_connection_close(daemon_, connection);
+      }
+      else {
+        daemon_connection_flush(daemon_, connection);
+      }
+    }
+    daemon_job_destroy(job);
+  }
+}
+
+void daemon_receive(daemon_state * const daemon_,
+                    daemon_connection * const connection) {
+  daemon_response response = {0};
+  daemon_job * job = NULL;
+  ssize_t received = 0;
+
+  while (!connection->closed) {
+    received = recv(connection->fd, connection->input + connection->input_size,
+                    sizeof(connection->input) - connection->input_size, 0);
+    if (received <= 0) {
+      if ( received < 0 && errno == EINTR ) {
+        continue;
+      }
+      if ( received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) ) {
+        break;
+      }
+      daemon_connection_close(daemon_, connection);
+      break;
+    }
+    connection->input_size += (size_t)received;
+    if ( connection->input_size < sizeof(connection->input) ) {
+      continue;
+    }
+    connection->input_size = 0;
+
+    job = stats_calloc( 1, sizeof(*job) );
+    if (!job) {
+      daemon_connection_close(daemon_, connection);
+      break;
+    }
+    memcpy( &job->request, connection->input, sizeof(job->request) );
+    if (job->request.option == 'q') {
+      response.id = job->request.id;
+      daemon_->stopping = 1;
+      daemon_job_destroy(job);
+      if ( !daemon_connection_append(connection, &response, sizeof(response)) ) {
+        daemon_connection_flush(daemon_, connection);
+      }
+      break;
+    }
+    job->task.run = daemon_job_run;
+    job->daemon_ = daemon_;
+    job->connection = connection;
+    ++connection->pending;
+    pool_submit(daemon_->pool_, &job->task);
+  }
+}
+
+void daemon_accept(daemon_state * const daemon_) {
+  struct epoll_event event = {0};
+  daemon_connection * connection = NULL;
+  int fd = -1;
+
+  for (;;) {
+    fd = accept4(daemon_->listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    connection = stats_calloc( 1, sizeof(*connection) );
+    if (!connection) {
+      close(fd);
+      continue;
+    }
+    connection->fd = fd;
+    event.events = EPOLLIN;
+    event.data.ptr = connection;
+    if ( epoll_ctl(daemon_->epoll_fd, EPOLL_CTL_ADD, fd, &event) ) {
+      close(fd);
+      free(connection);
+      continue;
+    }
+    connection->next = daemon_->connections;
+    daemon_->connections = connection;
+  }
+}
+
+/*  Closed connections are freed once the pool has no more jobs for them. */
+
+void daemon_collect(daemon_state * const daemon_) {
+  daemon_connection ** link = &daemon_->connections;
+  daemon_connection * connection = NULL;
+
+  while (*link) {
+    connection = *link;
+    if (connection->closed && !connection->pending) {
+      *link = connection->next;
+      free(connection->output);
+      free(connection);
+    }
+    else {
+      link = &connection->next;
+    }
+  }
+}
+
+int daemon_run(char const * const socket_path,
+               char const * const list_path,
+               size_t const max_size,
+               size_t const thread_count,
+               measure const * const measure_) {
+  daemon_state daemon_;
+  struct sockaddr_un address;
+  struct epoll_event event = {0};
+  struct epoll_event events[64];
+  struct stat status;
+  daemon_connection * connection = NULL;
+  int ret = 0;
+  int count = 0;
+  int i = 0;
+
+  memset( &daemon_, 0, sizeof(daemon_) );
+  memset( &address, 0, sizeof(address) );
+  daemon_.measure_ = *measure_;
+  daemon_.listen_fd = -1;
+  daemon_.event_fd = -1;
+  daemon_.epoll_fd = -1;
+  if ( strlen(socket_path) >= sizeof(address.sun_path) ) {
+    fprintf(stderr, "Error: The socket path is too long.\n");
+    return 1;
+  }
+  if ( pthread_mutex_init(&daemon_.mutex, NULL) ) {
+    return 1;
+  }
+
+  ret = corpus_create(list_path, max_size, &daemon_.corpus_);
+  if (ret) {
+    pthread_mutex_destroy(&daemon_.mutex);
+    return ret;
+  }
+  ret = pool_create(thread_count, &daemon_.pool_);
+  if (ret) {
+    corpus_destroy(daemon_.corpus_);
+    pthread_mutex_destroy(&daemon_.mutex);
+    return ret;
+  }
+
+  /* Replace a stale socket, but never any other kind of file. */
+  if ( !lstat(socket_path, &status) && S_ISSOCK(status.st_mode) ) {
+    unlink(socket_path);
+  }
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socket_path);
+  daemon_.listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  daemon_.event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  daemon_.epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if ( daemon_.listen_fd < 0 ||
+       daemon_.event_fd < 0 ||
+       daemon_.epoll_fd < 0 ||
+       bind(daemon_.listen_fd, (struct sockaddr const *)&address, sizeof(address)) ||
+       listen(daemon_.listen_fd, SOMAXCONN) ) {
+    fprintf(stderr, "Error: Could not listen on %s.\n", socket_path);
+    ret = 1;
+  }
+  if (!ret) {
+    event.events = EPOLLIN;
+    event.data.ptr = &daemon_.listen_fd;
+    ret = epoll_ctl(daemon_.epoll_fd, EPOLL_CTL_ADD, daemon_.listen_fd, &event) != 0;
+  }
+  if (!ret) {
+    event.events = EPOLLIN;
+    event.data.ptr = &daemon_.event_fd;
+    ret = epoll_ctl(daemon_.epoll_fd, EPOLL_CTL_ADD, daemon_.event_fd, &event) != 0;
+  }
+  if (!ret) {
+    fprintf(stderr, "Serving %" SIZE_T_FORMAT " files on %s.\n",
+            daemon_.corpus_->list->count, socket_path);
+  }
+
+  while (!ret && !daemon_.stopping) {
+    count = epoll_wait(daemon_.epoll_fd, events, 64, -1);
+    if (count < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      ret = 1;
+      break;
+    }
+    for (i = 0; i < count; ++i) {
+      if (events[i].data.ptr == &daemon_.listen_fd) {
+        daemon_accept(&daemon_);
+      }
+      else if (events[i].data.ptr == &daemon_.event_fd) {
+        daemon_complete(&daemon_);
+      }
+      else {
+        connection = events[i].data.ptr;
+        if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+          daemon_connection_close(&daemon_, connection);
+          continue;
+        }
+        if (events[i].events & EPOLLOUT) {
+          daemon_connection_flush(&daemon_, connection);
+        }
+        if (events[i].events & EPOLLIN) {
+          daemon_receive(&daemon_, connection);
+        }
+      }
+    }
+    daemon_collect(&daemon_);
+  }
+
+  /* Let the pool finish, then deliver what can be delivered. */
+  pool_destroy(daemon_.pool_);
+  daemon_complete(&daemon_);
+  for (connection = daemon_.connections; connection; connection = connection->next) {
+    daemon_connection_close(&daemon_, connection);
+  }
+  daemon_collect(&daemon_);
+  if (daemon_.epoll_fd >= 0) {
+    close(daemon_.epoll_fd);
+  }
+  if (daemon_.event_fd >= 0) {
+    close(daemon_.event_fd);
+  }
+  if (daemon_.listen_fd >= 0) {
+    close(daemon_.listen_fd);
+    unlink(socket_path);
+  }
+  corpus_destroy(daemon_.corpus_);
+  pthread_mutex_destroy(&daemon_.mutex);
+  return ret;
+}
+
+int read_fully(int const fd,
+               void * const data,
+               size_t const size) {
+  size_t done = 0;
+  ssize_t received = 0;
+
+  while (done < size) {
+    received = recv(fd, (char *)data + done, size - done, 0);
+    if (received < 0 && errno == EINTR) {
+      continue;
+    }
+    if (received <= 0) {
+      return 1;
+    }
+    done += (size_t)received;
+  }
+  return 0;
+}
+
+int client_run(char const * const socket_path,
+               char const option,
+               size_t const index_1,
+               size_t const index_2) {
+  struct sockaddr_un address;
+  daemon_request request = {0};
+  daemon_response response = {0};
+  daemon_result result = {0};
+  int fd = -1;
+  int ret = 0;
+  uint32_t i = 0;
+
+  memset( &address, 0, sizeof(address) );
+  if ( strlen(socket_path) >= sizeof(address.sun_path) ||
+       index_1 > UINT32_MAX ||
+       index_2 > UINT32_MAX ) {
+    return 1;
+  }
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socket_path);
+  fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if ( fd < 0 ||
+       connect(fd, (struct sockaddr const *)&address, sizeof(address)) ) {
+    fprintf(stderr, "Error: Could not connect to %s.\n", socket_path);
+    if (fd >= 0) {
+      close(fd);
+    }
+    return 1;
+  }
+
+  request.id = 1;
+  request.option = (unsigned char)option;
+  request.index_1 = (uint32_t)index_1;
+  request.index_2 = (uint32_t)index_2;
+  if ( sizeof(request) != send(fd, &request, sizeof(request), MSG_NOSIGNAL) ||
+       read_fully(fd, &response, sizeof(response)) ) {
+    fprintf(stderr, "Error: Could not talk to the daemon.\n");
+    close(fd);
+    return 1;
+  }
+  if (response.status) {
+    fprintf(stderr, "Error: The daemon could not serve the request.\n");
+    close(fd);
+    return 1;
+  }
+  for (i = 0; !ret && i < response.count; ++i) {
+    ret = read_fully(fd, &result, sizeof(result));
+    if (!ret) {
+      if (option == 'k') {
+        ret = printf("%" PRIu64 " %" PRIu64 "\n", result.index, result.value) < 0;
+      }
+      else {
+        ret = printf("%" PRIu64 "\n", result.value) < 0;
+      }
+    }
+  }
+  close(fd);
+  return ret;
+}
+
+#endif /* __linux__ && !NO_THREADS */
+
+
+
+/* Command-line interface */
+
+typedef struct {
+  char const * cache_path;
+  char const * batch_path;
+  int sharded;
+  shard shard_;
+  size_t max_memory;
+  size_t thread_count;
+  char const * profile_path;
+  char units; /* 'l' for lines, 't' for tokens, or '\0' for bytes */
+  char metric;
+  char const * costs_path;
+  costs * costs_; /* read by main */
+  char const * calibration_path;
+  calibration * calibration_; /* read by main */
+  int explain;
+  int thresholded;
+  size_t threshold; /* for -a */
+  char stats_format; /* 'h' for human, 'j' for JSON, or '\0' */
+  int perf;
+  char const * trace_path;
+} settings;
+
+/*  settings_parse consumes the flags that precede the option. */
+
+int settings_parse(settings * const settings_,
+                   int * const argi,
+                   int const argc,
+                   char * argv[]) {
+  int i = *argi;
+
+  for (; i < argc && !strncmp(argv[i], "--", 2); ++i) {
+    if ( !strcmp(argv[i], "--cache") && i + 1 < argc ) {
+      settings_->cache_path = argv[++i];
+    }
+    else if ( !strcmp(argv[i], "--profile") && i + 1 < argc ) {
+      settings_->profile_path = argv[++i];
+    }
+    else if ( !strcmp(argv[i], "--metric") && i + 1 < argc ) {
+      ++i;
+      if ( !strcmp(argv[i], "levenshtein") ) {
+        settings_->metric = 'l';
+      }
+      else if ( !strcmp(argv[i], "indel") ) {
+        settings_->metric = 'i';
+      }
+      else if ( !strcmp(argv[i], "osa") ) {
+        settings_->metric = 'o';
+      }
+      else {
+        return 1;
+      }
+    }
+    else if ( !strcmp(argv[i], "--costs") && i + 1 < argc ) {
+      settings_->costs_path = argv[++i];
+    }
+    else if ( !strcmp(argv[i], "--units") && i + 1 < argc ) {
+      ++i;
+      if ( !strcmp(argv[i], "lines") ) {
+        settings_->units = 'l';
+      }
+      else if ( !strcmp(argv[i], "tokens") ) {
+        settings_->units = 't';
+      }
+      else {
+        return 1;
+      }
+    }
+    else if ( !strcmp(argv[i], "--calibration") && i + 1 < argc ) {
+      settings_->calibration_path = argv[++i];
+    }
+    else if ( !strcmp(argv[i], "--explain") ) {
+      settings_->explain = 1;
+    }
+    else if ( !strcmp(argv[i], "--stats") && i + 1 < argc ) {
+      ++i;
+      if ( !strcmp(argv[i], "human") ) {
+        settings_->stats_format = 'h';
+      }
+      else if ( !strcmp(argv[i], "json") ) {
+        settings_->stats_format = 'j';
+      }
+      else {
+        return 1;
+      }
+    }
+    else if ( !strcmp(argv[i], "--perf") ) {
+      settings_->perf = 1;
+    }
+    else if ( !strcmp(argv[i], "--trace") && i + 1 < argc ) {
+      settings_->trace_path = argv[++i];
+    }
+    else if ( !strcmp(argv[i], "--threshold") && i + 1 < argc ) {
+      if ( size_t_from_string(&settings_->threshold, argv[++i]) ) {
+        return 1;
+      }
+      settings_->thresholded = 1;
+    }
+    else if ( !strcmp(argv[i], "--batch") && i + 1 < argc ) {
+      settings_->batch_path = argv[++i];
+    }
+    else if ( !strcmp(argv[i], "--max-memory") && i + 1 < argc ) {
+      if ( size_t_from_memory_string(&settings_->max_memory, argv[++i]) ||
+           !settings_->max_memory ) {
+        return 1;
+      }
+    }
+    else if ( !strcmp(argv[i], "--threads") && i + 1 < argc ) {
+      if ( size_t_from_string(&settings_->thread_count, argv[++i]) ||
+           !settings_->thread_count ) {
+        return 1;
+      }
+    }
+    else if ( !strcmp(argv[i], "--shard") && i + 1 < argc ) {
+      if ( shard_from_string(&settings_->shard_, argv[++i]) ) {
+        return 1;
+      }
+      settings_->sharded = 1;
+    }
+    else {
+      return 1;
+    }
+  }
+
+  if (settings_->sharded && !settings_->batch_path) {
+    return 1;
+  }
+  if (!settings_->sharded) {
+    settings_->shard_.index = 0;
+    settings_->shard_.count = 1;
+  }
+  if (!settings_->thread_count) {
+    settings_->thread_count = get_processor_count();
+  }
+  if (settings_->costs_path) {
+    if (settings_->metric) {
+      return 1;
+    }
+    settings_->metric = 'w';
+  }
+  if (!settings_->metric) {
+    settings_->metric = 'l';
+  }
+  if (settings_->perf && !settings_->stats_format) {
+    settings_->stats_format = 'h';
+  }
+
+  *argi = i;
+  return 0;
+}
+
+int print_usage(void) {
+  fputs(
+    "Usage: program [flags] option file1 file2 [read_limit]                         \n"
+    "       program [flags] --batch list_file option [read_limit]                   \n"
+    "       program merge format shard_output...                                    \n"
+    "       program [flags] daemon socket_path list_file [read_limit]               \n"
+    "       program client socket_path request                                      \n"
+    "       program [flags] tree option directory1 directory2 [read_limit]          \n"
+    "       program [flags] watch directory threshold [read_limit]                  \n"
+    "       program many probe_file list_file [threshold [read_limit]]              \n"
+    "       program profile file profile_file [read_limit]                          \n"
+    "       program [flags] --profile profile_file option file2 [read_limit]        \n"
+    "       program stream [-z] (reference_file | -p) [input_file]                  \n"
+    "       program search pattern_file text_file k                                 \n"
+    "       program [flags] windows option file1 file2 window_size [read_limit]     \n"
+    "       program [flags] sample file1 file2 [read_limit]                         \n"
+    "About:                                                                         \n"
+    " This program interprets each file as the bytestring that the file contains;   \n"
+    " then, the program prints (a bound on) the Levenshtein distance between the    \n"
+    " two bytestrings. The exit status is zero if and only if the program succeeded.\n"
+    " Please note: A computation of a bound takes considerably less time than the   \n"
+    " computation of the distance, if the files are large.                          \n"
+    " For large files, you may want to specify a read_limit. This limits the number \n"
+    " of bytes that the program can read from each file; thus, only a prefix of the \n"
+    " contained bytestring will be used for the desired computation.                \n"
+    "Options:                                                                       \n"
+    " -d  Print the Levenshtein distance.                                           \n"
+    " -l  Print a lower bound on the distance. (takes the least amount of time)     \n"
+    " -u  Print an upper bound.                                                     \n"
+    " -a  Print a JSON object with the sizes, both bounds, the distance and the     \n"
+    "     time of each stage, for a pair of files. The bounds are computed          \n"
+    "     concurrently; the distance is skipped if they meet. Not with --cache,     \n"
+    "     --batch, --profile, --units or --explain.                                 \n",
+    stderr
+  );
+  fputs(
+    "Flags:                                                                         \n"
+    " --cache cache_file  Look up results in, and add results to, the cache_file.   \n"
+    "                     Results are keyed by the hashes of the bytestrings and by \n"
+    "                     the option. The cache_file is created if it is missing.   \n"
+    "                     Of the commands, only tree and windows accept it.         \n"
+    " --batch list_file   Compute the results for all pairs of the files listed in  \n"
+    "                     the list_file, one path per line. Each output line holds  \n"
+    "                     the indices i < j of a pair and the result.               \n"
+    " --shard k/N         Only compute the k-th of N shards (k = 0, ..., N-1) of the\n"
+    "                     batch. The shards are balanced by estimated cost.         \n"
+    " --max-memory bytes  Keep the memory of a batch, or of a pair of files, within \n"
+    "                     the given number of bytes (suffixes: K, M, G). A batch    \n"
+    "                     splits it between the files that are resident and the     \n"
+    "                     computations; for a pair, the files are mapped instead of \n"
+    "                     read. A computation that cannot keep within its part      \n"
+    "                     fails before it starts. Not with --profile, --units or    \n"
+    "                     commands.                                                 \n"
+    " --threads count     Use count threads for computations. (default: the number  \n"
+    "                     of processors)                                            \n"
+    " --profile file      Compare file2 with the reference that the profile file    \n"
+    "                     stores; then, the read_limit only applies to file2.       \n"
+    " --units kind        Compare lines or tokens (kind: lines, tokens) instead of  \n"
+    "                     bytes, for a pair of files. Two results are printed: the  \n"
+    "                     one for units, and the one where each unit weighs its     \n"
+    "                     size in bytes. Not with --cache, --batch or --profile.    \n"
+    " --metric name       Compute the distance of the metric (name: levenshtein,    \n"
+    "                     the default; indel, which only counts insertions and      \n"
+    "                     deletions; or osa, which also counts a transposition of   \n"
+    "                     adjacent bytes as one edit), or bounds on it. The many,   \n"
+    "                     stream, search and sample commands only support the       \n"
+    "                     Levenshtein distance.                                     \n"
+    " --costs cost_file   Compute the weighted edit distance from file1 to file2,   \n"
+    "                     or bounds on it, with the costs of the cost_file (see     \n"
+    "                     below). Not with --metric.                                \n"
+    " --calibration file  Plan distance computations with the speeds stored in the  \n"
+    "                     file. If it is missing, or if it was written on another   \n"
+    "                     processor, the speeds are measured and stored in it.      \n"
+    " --threshold k       With -a, only decide whether the distance is at most k;   \n"
+    "                     if it is not, the distance is null.                       \n"
+    " --explain           Print which algorithm computes the distance (-d) and why, \n"
+    "                     to the standard error, for a pair of files. Not with      \n"
+    "                     --cache, --batch, --profile, --units or --costs.          \n",
+    stderr
+  );
+  fputs(
+    " --stats format      When the command has run, report the time of each phase   \n"
+    "                     (file sizes, reading, histograms, chunk loops, dynamic    \n"
+    "                     programming), the bytes read, the cells evaluated, the    \n"
+    "                     allocations and the peak memory to the standard error     \n"
+    "                     (format: human, json).                                    \n"
+    " --perf              Add the hardware performance counters of each phase to    \n"
+    "                     the statistics (default format: human), on Linux: the     \n"
+    "                     cycles, instructions, instructions per cycle, cache misses\n"
+    "                     of the first and the last level, and branch misses, also  \n"
+    "                     per cell of the dynamic programming; on the Intel cores   \n"
+    "                     from Skylake to Tiger Lake, also the cycles under the AVX \n"
+    "                     frequency licences 1 and 2.                               \n"
+    " --trace file        Write a timeline of the threads to the file, in the trace \n"
+    "                     event format of Chrome (chrome://tracing, Perfetto): their\n"
+    "                     tasks and waits, the loads of files and tiles, the lower  \n"
+    "                     bound, upper bound and distance stages, and the kernels.  \n",
+    stderr
+  );
+  fputs(
+    "Costs:                                                                         \n"
+    " Each line of a cost_file holds a statement; later ones override earlier ones, \n"
+    " and lines that start with # are ignored. Costs range from 0 to 255; unless    \n"
+    " set, they are 1. A byte is a character or 0x followed by two hex digits.      \n"
+    "  insert [byte] cost           Set the cost of inserting (the byte).           \n"
+    "  delete [byte] cost           Set the cost of deleting (the byte).            \n"
+    "  substitute [byte byte] cost  Set the cost of substituting (the first byte by \n"
+    "                               the second).                                    \n"
+    "  class bytes cost             Set the cost of substituting any of the bytes by\n"
+    "                               any other of them.                              \n"
+    "  case cost                    Set the cost of substituting an ASCII letter by \n"
+    "                               itself in the other case.                       \n"
+    "Merging:                                                                       \n"
+    " The merge command combines the outputs of all shards of a batch. The format   \n"
+    " -p prints the complete batch output; the format -m prints the matrix of       \n"
+    " results.                                                                      \n"
+    "Trees:                                                                         \n"
+    " The tree command matches the regular files of both directory trees by relative\n"
+    " path and computes the result for each path in parallel; a file that occurs in \n"
+    " one tree only is compared with an empty file. Each output line holds a result,\n"
+    " a status (= identical, ~ different, - only in directory1, + only in           \n"
+    " directory2) and the path; the lines are ordered by descending result.         \n"
+    "Watching:                                                                      \n"
+    " The watch command indexes the files in the directory. Whenever a file is      \n"
+    " written to or moved into the directory, it prints a line for each other file  \n"
+    " within the threshold distance: both file names and the distance.              \n",
+    stderr
+  );
+  fputs(
+    "One versus many:                                                               \n"
+    " The many command prints the distance between the probe_file and each listed   \n"
+    " file, as lines \"index distance\". With a threshold, it only prints the files  \n"
+    " within the threshold. Files that share prefixes share the work for them.      \n"
+    " Files of up to 64 bytes are compared with the probe_file eight at a time.     \n"
+    "Profiles:                                                                      \n"
+    " The profile command precomputes what comparisons with the file need and saves \n"
+    " it, together with the file, to the profile_file. Repeated comparisons with the\n"
+    " same reference take less time with the --profile flag.                        \n"
+    "Streams:                                                                       \n"
+    " The stream command reads records from the input_file, or from the standard    \n"
+    " input if it is missing or -, and prints the distance of each record, one per  \n"
+    " line. Records end with a newline, or with a NUL byte if -z is given. Each     \n"
+    " record is compared with the content of the reference_file; with -p, the part  \n"
+    " of the record before its first tab is compared with the part after it.        \n"
+    "Windows:                                                                       \n"
+    " The windows command splits both files into windows of window_size bytes       \n"
+    " (suffixes: K, M, G) and prints, for the i-th windows of both files, the line  \n"
+    " \"offset result\", where offset = i * window_size. Windows are compared in      \n"
+    " parallel; the results show where the files diverge.                           \n"
+    "Sampling:                                                                      \n"
+    " The sample command estimates the distance from windows of the longer file,    \n"
+    " drawn at random from 64 strata; each is compared with the part of the other   \n"
+    " file around the corresponding offset, in parallel. It prints the line         \n"
+    " \"estimate low high lower_bound upper_bound\", where low and high delimit an    \n"
+    " approximate 95 percent confidence interval; all of them are within the bounds.\n"
+    " Files of up to 64 KiB are compared exactly.                                   \n"
+    "Searching:                                                                     \n"
+    " The search command finds the pattern in the text_file (- for the standard     \n"
+    " input) approximately: for each end offset e in the text at which a substring  \n"
+    " of the text within the distance k of the pattern ends, it prints the line     \n"
+    " \"e d\", where d is the least such distance.                                    \n"
+    "Daemon:                                                                        \n"
+    " The daemon keeps the files listed in the list_file in memory and serves       \n"
+    " requests on the Unix domain socket socket_path; files are referred to by their\n"
+    " indices. The client sends one request and prints the response. Requests:      \n"
+    "  -d i j, -l i j, -u i j  Print the distance or a bound for the files i and j. \n"
+    "  -k i k                  Print the k files closest to the file i, with their  \n"
+    "                          distances.                                           \n"
+    "  -q                      Stop the daemon.                                     \n",
+    stderr
+  );
+  return 1;
+}
+
+int option_valid(char const * const string,
+                 char const * const options) {
+  return string[0] == '-' &&
+         string[1] != '\0' &&
+         string[2] == '\0' &&
+         strchr(options, string[1]) != NULL;
+}
+
+measure get_measure(settings const * const settings_,
+                    char const * const option) {
+  measure measure_;
+
+  measure_.option = option[1];
+  measure_.metric = settings_->metric;
+  measure_.costs_ = settings_->costs_;
+  measure_.calibration_ = settings_->calibration_;
+  measure_.max_memory = 0;
+  return measure_;
+}
+
+int read_limit_from_string(size_t * const max_size,
+                           char const * const string) {
+  int const ret = size_t_from_string(max_size, string);
+  if (ret) {
+    fprintf(stderr, "Error: Could not accept read_limit.\n");
+  }
+  return ret;
+}
+
+int threshold_from_string(size_t * const threshold,
+                          char const * const string) {
+  int const ret = size_t_from_string(threshold, string);
+  if (ret) {
+    fprintf(stderr, "Error: Could not accept threshold.\n");
+  }
+  return ret;
+}
+
+int flush_output(int const ret) {
+  if (ret) {
+    return ret;
+  }
+  if ( fflush(stdout) ) {
+    fprintf(stderr, "Error: Could not flush.\n");
+    return 1;
+  }
+  return 0;
+}
+
+int open_cache(settings const * const settings_,
+               cache ** const cache_) {
+  int ret = 0;
+
+  *cache_ = NULL;
+  if (settings_->cache_path) {
+    ret = cache_create(settings_->cache_path, cache_);
+    if (ret) {
+      fprintf(stderr, "Error: Could not open cache.\n");
+    }
+  }
+  return ret;
+}
+
+/*  Each command receives the arguments that follow the flags; the first one
+    is the name of the command.
+*/
+
+int command_merge(settings const * const settings_,
+                  int const argc,
+                  char * argv[]) {
+  (void)settings_;
+  if ( argc < 3 ||
+       !option_valid(argv[1], "mp") ) {
+    return print_usage();
+  }
+  return flush_output( merge_run(argv[1][1], argc - 2, argv + 2) );
+}
+
+int command_daemon(settings const * const settings_,
+                   int const argc,
+                   char * argv[]) {
+  size_t max_size = SIZE_MAX;
+
+  if ( argc != 3 &&
+       argc != 4 ) {
+    return print_usage();
+  }
+  if ( argc == 4 &&
+       read_limit_from_string(&max_size, argv[3]) ) {
+    return 1;
+  }
+#if defined(__linux__) && !defined(NO_THREADS)
+  {
+    measure const measure_ = get_measure(settings_, "-d");
+
+    return daemon_run(argv[1], argv[2], max_size, settings_->thread_count,
+                      &measure_);
+  }
+#else
+  (void)settings_;
+  fprintf(stderr, "Error: The daemon is not supported on this platform.\n");
+  return 1;
+#endif
+}
+
+int command_client(settings const * const settings_,
+                   int const argc,
+                   char * argv[]) {
+  size_t index_1 = 0;
+  size_t index_2 = 0;
+
+  (void)settings_;
+  if ( argc < 3 ||
+       !option_valid(argv[2], "dlukq") ||
+       argv[2][1] == 'q' && argc != 3 ||
+       argv[2][1] != 'q' && argc != 5 ) {
+    return print_usage();
+  }
+  if ( argc == 5 &&
+       (size_t_from_string(&index_1, argv[3]) ||
+        size_t_from_string(&index_2, argv[4])) ) {
+    return print_usage();
+  }
+#if defined(__linux__) && !defined(NO_THREADS)
+  return flush_output( client_run(argv[1], argv[2][1], index_1, index_2) );
+#else
+  fprintf(stderr, "Error: The client is not supported on this platform.\n");
+  return 1;
+#endif
+}
+
+int command_tree(settings const * const settings_,
+                 int const argc,
+                 char * argv[]) {
+  size_t max_size = SIZE_MAX;
+  int ret = 0;
+
+  if ( argc != 4 &&
+       argc != 5 ||
+       !option_valid(argv[1], "dlu") ) {
+    return print_usage();
+  }
+  if ( argc == 5 &&
+       read_limit_from_string(&max_size, argv[4]) ) {
+    return 1;
+  }
+#ifdef __linux__
+  {
+    measure const measure_ = get_measure(settings_, argv[1]);
+    cache * cache_ = NULL;
+
+    ret = open_cache(settings_, &cache_);
+    if (ret) {
       return ret;
     }
+    ret = tree_run(&measure_, argv[2], argv[3], max_size,
+                   settings_->thread_count, cache_);
+    cache_destroy(cache_);
+    return flush_output(ret);
   }
-  t_2 = distance(buffer_1->size,
-                 buffer_2->size);
-  ret = size_t_add_aug(&t_1, t_2);
-  if (ret) {
-    return ret;
-  }
-  if (t_1) {
-    t_1 = 1 + (t_1 - 1) / 2;
+#else
+  (void)settings_;
+  (void)ret;
+  fprintf(stderr, "Error: Comparing trees is not supported on this platform.\n");
+  return 1;
+#endif
+}
+
+int command_watch(settings const * const settings_,
+                  int const argc,
+                  char * argv[]) {
+  size_t max_size = SIZE_MAX;
+  size_t threshold = 0;
+
+  (void)settings_;
+  if ( argc != 3 &&
+       argc != 4 ) {
+    return print_usage();
   }
-  if (bound_ < t_1) {
-      bound_ = t_1;
+  if ( threshold_from_string(&threshold, argv[2]) ||
+       argc == 4 && read_limit_from_string(&max_size, argv[3]) ) {
+    return 1;
   }
+#ifdef __linux__
+  {
+    measure const measure_ = get_measure(settings_, "-d");
 
-  *bound = bound_;
-  return 0;
+    return watch_run(argv[1], threshold, max_size, &measure_);
+  }
+#else
+  fprintf(stderr, "Error: Watching is not supported on this platform.\n");
+  return 1;
+#endif
 }
 
+int command_many(settings const * const settings_,
+                 int const argc,
+                 char * argv[]) {
+  size_t max_size = SIZE_MAX;
+  size_t threshold = SIZE_MAX;
+  buffer * probe = NULL;
+  corpus * corpus_ = NULL;
+  size_t * distances = NULL;
+  size_t i = 0;
+  int ret = 0;
 
+  if (settings_->metric != 'l') {
+    return print_usage();
+  }
+  if (argc < 3 ||
+      argc > 5) {
+    return print_usage();
+  }
+  if ( argc >= 4 && threshold_from_string(&threshold, argv[3]) ||
+       argc == 5 && read_limit_from_string(&max_size, argv[4]) ) {
+    return 1;
+  }
+  ret = buffer_create(argv[1], max_size, &probe);
+  if (ret) {
+    fprintf(stderr, "Error: Could not read probe file.\n");
+    return ret;
+  }
+  ret = corpus_create(argv[2], max_size, &corpus_);
+  if (ret) {
+    buffer_destroy(probe);
+    return ret;
+  }
+  distances = stats_calloc( corpus_->list->count + 1, sizeof(*distances) );
+  ret = !distances ||
+        get_levenshtein_distances(probe, corpus_->buffers, corpus_->list->count,
+                                  threshold, distances);
+  if (ret) {
+    fprintf(stderr, "Error: Computation failed.\n");
+  }
+  for (i = 0; !ret && i < corpus_->list->count; ++i) {
+    if (distances[i] != SIZE_MAX) {
+      ret = printf("%" SIZE_T_FORMAT " %" SIZE_T_FORMAT "\n", i, distances[i]) < 0;
+    }
+  }
+  free(distances);
+  corpus_destroy(corpus_);
+  buffer_destroy(probe);
+  return flush_output(ret);
+}
 
-/* Computing an upper bound on the Levenshtein distance */
+int command_profile(settings const * const settings_,
+                    int const argc,
+                    char * argv[]) {
+  size_t max_size = SIZE_MAX;
+  buffer * buffer_ = NULL;
+  int ret = 0;
 
-size_t minimum(size_t const size_1,
-               size_t const size_2) {
-  if (size_1 < size_2) {
-    return size_1;
+  (void)settings_;
+  if ( argc != 3 &&
+       argc != 4 ) {
+    return print_usage();
   }
-  return size_2;
+  if ( argc == 4 &&
+       read_limit_from_string(&max_size, argv[3]) ) {
+    return 1;
+  }
+  ret = buffer_create(argv[1], max_size, &buffer_);
+  if (ret) {
+    fprintf(stderr, "Error: Could not read file.\n");
+    return ret;
+  }
+  ret = profile_write(buffer_, argv[2]);
+  if (ret) {
+    fprintf(stderr, "Error: Could not write profile.\n");
+  }
+  buffer_destroy(buffer_);
+  return ret;
 }
 
-int get_ld_ub(buffer const * const buffer_1,
-              buffer const * const buffer_2,
-              size_t * const bound) { /* upper bound */
-  size_t bound_ = 0;
+int command_stream(settings const * const settings_,
+                   int const argc,
+                   char * argv[]) {
+  char delimiter = '\n';
+  int argi = 1;
+  buffer * reference = NULL;
+  FILE * input = stdin;
   int ret = 0;
-  size_t buf_1_t = 0;
-  size_t buf_2_t = 0;
-  buffer sub_buf_1 = {0};
-  buffer sub_buf_2 = {0};
-  size_t distance = 0;
-  
-  buf_1_t = buffer_1->size;
-  buf_2_t = buffer_2->size;
-  sub_buf_1.pointer = buffer_1->pointer;
-  sub_buf_2.pointer = buffer_2->pointer;
-  sub_buf_1.size = minimum(buf_1_t, 1024);
-  sub_buf_2.size = minimum(buf_2_t, 1024);
 
-  while (sub_buf_1.size ||
-         sub_buf_2.size) {
-    ret = get_levenshtein_distance(&sub_buf_1,
-                                   &sub_buf_2,
-                                   &distance);
+  if (settings_->metric != 'l') {
+    return print_usage();
+  }
+  if ( argi < argc && !strcmp(argv[argi], "-z") ) {
+    delimiter = '\0';
+    ++argi;
+  }
+  if ( argc - argi != 1 &&
+       argc - argi != 2 ) {
+    return print_usage();
+  }
+  if ( strcmp(argv[argi], "-p") ) {
+    ret = buffer_create(argv[argi], SIZE_MAX, &reference);
     if (ret) {
+      fprintf(stderr, "Error: Could not read reference file.\n");
       return ret;
     }
-    bound_ += distance;
-    
-    buf_1_t -= sub_buf_1.size;
-    buf_2_t -= sub_buf_2.size;
-    sub_buf_1.pointer += sub_buf_1.size;
-    sub_buf_2.pointer += sub_buf_2.size;
-    sub_buf_1.size = minimum(buf_1_t, sub_buf_1.size);
-    sub_buf_2.size = minimum(buf_2_t, sub_buf_2.size);
   }
+  if ( argc - argi == 2 && strcmp(argv[argi + 1], "-") ) {
+    input = fopen(argv[argi + 1], "rb");
+    if (!input) {
+      buffer_destroy(reference);
+      fprintf(stderr, "Error: Could not open input file.\n");
+      return 1;
+    }
+  }
+#ifdef _MSC_VER
+  else {
+    _setmode(_fileno(stdin), _O_BINARY);
+  }
+#endif
+  ret = stream_run(delimiter, reference, input);
+  if (input != stdin) {
+    fclose(input);
+  }
+  buffer_destroy(reference);
+  return ret;
+}
 
-  *bound = bound_;
-  return 0;
+int command_search(settings const * const settings_,
+                   int const argc,
+                   char * argv[]) {
+  buffer * pattern = NULL;
+  FILE * input = stdin;
+  size_t k = 0;
+  int ret = 0;
+
+  if (settings_->metric != 'l') {
+    return print_usage();
+  }
+  if (argc != 4) {
+    return print_usage();
+  }
+  if ( threshold_from_string(&k, argv[3]) ) {
+    return 1;
+  }
+  ret = buffer_create(argv[1], SIZE_MAX, &pattern);
+  if (ret) {
+    fprintf(stderr, "Error: Could not read pattern file.\n");
+    return ret;
+  }
+  if ( strcmp(argv[2], "-") ) {
+    input = fopen(argv[2], "rb");
+    if (!input) {
+      buffer_destroy(pattern);
+      fprintf(stderr, "Error: Could not open text file.\n");
+      return 1;
+    }
+  }
+#ifdef _MSC_VER
+  else {
+    _setmode(_fileno(stdin), _O_BINARY);
+  }
+#endif
+  ret = search_run(pattern, k, input);
+  if (input != stdin) {
+    fclose(input);
+  }
+  buffer_destroy(pattern);
+  return flush_output(ret);
+}
+
+int command_windows(settings const * const settings_,
+                    int const argc,
+                    char * argv[]) {
+  size_t max_size = SIZE_MAX;
+  size_t window_size = 0;
+  measure measure_;
+  cache * cache_ = NULL;
+  int ret = 0;
+
+  if ( argc != 5 &&
+       argc != 6 ||
+       !option_valid(argv[1], "dlu") ) {
+    return print_usage();
+  }
+  if ( size_t_from_memory_string(&window_size, argv[4]) ||
+       !window_size ) {
+    fprintf(stderr, "Error: Could not accept window_size.\n");
+    return 1;
+  }
+  if ( argc == 6 &&
+       read_limit_from_string(&max_size, argv[5]) ) {
+    return 1;
+  }
+  ret = open_cache(settings_, &cache_);
+  if (ret) {
+    return ret;
+  }
+  measure_ = get_measure(settings_, argv[1]);
+  ret = windows_run(&measure_, argv[2], argv[3], window_size, max_size,
+                    settings_->thread_count, cache_);
+  cache_destroy(cache_);
+  return flush_output(ret);
 }
 
+int command_sample(settings const * const settings_,
+                   int const argc,
+                   char * argv[]) {
+  buffer * buffer_1 = NULL;
+  buffer * buffer_2 = NULL;
+  size_t max_size = SIZE_MAX;
+  int ret = 0;
 
+  if (settings_->metric != 'l') {
+    return print_usage();
+  }
+  if (argc != 3 &&
+      argc != 4) {
+    return print_usage();
+  }
+  if ( argc == 4 &&
+       read_limit_from_string(&max_size, argv[3]) ) {
+    return 1;
+  }
+  ret = buffer_create(argv[1], max_size, &buffer_1);
+  if (ret) {
+    fprintf(stderr, "Error: Could not read first file.\n");
+    return ret;
+  }
+  ret = buffer_create(argv[2], max_size, &buffer_2);
+  if (ret) {
+    buffer_destroy(buffer_1);
+    fprintf(stderr, "Error: Could not read second file.\n");
+    return ret;
+  }
+  ret = sample_run(buffer_1, buffer_2, settings_->thread_count);
+  buffer_destroy(buffer_2);
+  buffer_destroy(buffer_1);
+  return flush_output(ret);
+}
 
-/* Command-line interface */
+/*  main rejects the flags that a command would ignore: --batch, --profile,
+    --units, --explain and --max-memory always, and --cache unless the command
+    caches its results.
+*/
 
-int main( int argc, char * argv[] ) {
+typedef struct {
+  char const * name;
+  int (* run)(settings const *, int, char **);
+  int cached; /* whether it accepts --cache */
+} command;
+
+command const commands[] = {
+  { "merge",   command_merge,   0 },
+  { "daemon",  command_daemon,  0 },
+  { "client",  command_client,  0 },
+  { "tree",    command_tree,    1 },
+  { "watch",   command_watch,   0 },
+  { "many",    command_many,    0 },
+  { "profile", command_profile, 0 },
+  { "stream",  command_stream,  0 },
+  { "search",  command_search,  0 },
+  { "windows", command_windows, 1 },
+  { "sample",  command_sample,  0 },
+  { NULL,      NULL,            0 }
+};
+
+/*  command_compare compares a pair of files, or the pairs of a batch; its
+    first argument is the option.
+*/
+
+int command_compare(settings const * const settings_,
+                    int const argc,
+                    char * argv[]) {
   int ret = 0;
+  int positional = 0;
+  cache * cache_ = NULL;
+  profile * profile_ = NULL;
+  mapping * mappings[2] = {NULL, NULL};
   buffer * buffer_1 = NULL;
   buffer * buffer_2 = NULL;
   size_t max_size = SIZE_MAX;
   size_t printee = 0;
+  size_t results[2] = {0, 0};
+  double memory = 0;
+  double begin = 0;
+  double load_time = 0;
+  int all = 0;
+  measure measure_;
 
-  if ( argc != 4 &&
-       argc != 5 ||
-       strcmp(argv[1], "-d") &&
-       strcmp(argv[1], "-l") &&
-       strcmp(argv[1], "-u") ) {
-    fprintf(stderr,
-      "Usage: program option file1 file2 [read_limit]                                 \n"
-      "About:                                                                         \n"
-      " This program interprets each file as the bytestring that the file contains;   \n"
-      " then, the program prints (a bound on) the Levenshtein distance between the    \n"
-      " two bytestrings. The exit status is zero if and only if the program succeeded.\n"
-      " Please note: A computation of a bound takes considerably less time than the   \n"
-      " computation of the distance, if the files are large.                          \n"
-      " For large files, you may want to specify a read_limit. This limits the number \n"
-      " of bytes that the program can read from each file; thus, only a prefix of the \n"
-      " contained bytestring will be used for the desired computation.                \n"
-      "Options:                                                                       \n"
-      " -d  Print the Levenshtein distance.                                           \n"
-      " -l  Print a lower bound on the distance. (takes the least amount of time)     \n"
-      " -u  Print an upper bound.                                                     \n"
-    );
-    return 1;
-  }
-
-  if (argc == 5) {
-    ret = size_t_from_string( &max_size, argv[4] );
-    if (ret) {
-      fprintf(stderr, "Error: Could not accept read_limit.\n");
-      return ret;
-    }
+  positional = settings_->batch_path ? 1 : settings_->profile_path ? 2 : 3;
+  all = option_valid(argv[0], "a");
+  if ( argc != positional &&
+       argc != positional + 1 ||
+       !all && !option_valid(argv[0], "dlu") ||
+       all && (settings_->batch_path ||
+               settings_->profile_path ||
+               settings_->units ||
+               settings_->cache_path ||
+               settings_->explain) ||
+       settings_->thresholded && !all ||
+       settings_->batch_path && settings_->profile_path ||
+       settings_->units && (settings_->batch_path ||
+                            settings_->profile_path ||
+                            settings_->cache_path ||
+                            settings_->metric != 'l') ||
+       settings_->explain && (settings_->batch_path ||
+                              settings_->profile_path ||
+                              settings_->units ||
+                              settings_->cache_path ||
+                              settings_->metric == 'w' ||
+                              argv[0][1] != 'd') ||
+       settings_->max_memory && !settings_->batch_path &&
+                                (settings_->profile_path ||
+                                 settings_->units) ) {
+    return print_usage();
+  }
+
+  if ( argc == positional + 1 &&
+       read_limit_from_string(&max_size, argv[positional]) ) {
+    return 1;
+  }
+  measure_ = get_measure(settings_, argv[0]);
+  if (!settings_->batch_path) {
+    measure_.max_memory = settings_->max_memory;
   }
 
-  ret = buffer_create( argv[2], max_size, &buffer_1 );
+  ret = open_cache(settings_, &cache_);
   if (ret) {
-    fprintf(stderr, "Error: Could not read first file.\n");
     return ret;
   }
 
-  ret = buffer_create( argv[3], max_size, &buffer_2 );
+  if (settings_->batch_path) {
+    ret = batch_run(&measure_, settings_->batch_path, &settings_->shard_,
+                    max_size, settings_->max_memory,
+                    settings_->thread_count, cache_);
+    cache_destroy(cache_);
+    return flush_output(ret);
+  }
+
+  begin = get_time();
+  if (settings_->profile_path) {
+    ret = profile_create(settings_->profile_path, &profile_);
+    if (ret) {
+      cache_destroy(cache_);
+      fprintf(stderr, "Error: Could not read profile.\n");
+      return ret;
+    }
+  }
+  else if (measure_.max_memory) {
+    ret = buffer_map( argv[1], max_size, &mappings[0], &buffer_1 );
+    if (ret) {
+      cache_destroy(cache_);
+      fprintf(stderr, "Error: Could not read first file.\n");
+      return ret;
+    }
+  }
+  else {
+    ret = buffer_create( argv[1], max_size, &buffer_1 );
+    if (ret) {
+      cache_destroy(cache_);
+      fprintf(stderr, "Error: Could not read first file.\n");
+      return ret;
+    }
+  }
+
+  if (measure_.max_memory) {
+    ret = buffer_map( argv[positional - 1], max_size, &mappings[1], &buffer_2 );
+  }
+  else {
+    ret = buffer_create( argv[positional - 1], max_size, &buffer_2 );
+  }
   if (ret) {
-    buffer_destroy(buffer_1);
+    buffer_unmap(buffer_1, mappings[0]);
+    profile_destroy(profile_);
+    cache_destroy(cache_);
     fprintf(stderr, "Error: Could not read second file.\n");
     return ret;
   }
+  load_time = get_time() - begin;
 
-  switch ( argv[1][1] ) {
-  case 'd':
-    ret = get_levenshtein_distance(buffer_1, buffer_2, &printee);
-    break;
-  case 'l':
-    ret = get_ld_lb(buffer_1, buffer_2, &printee);
-    break;
-  case 'u':
-    ret = get_ld_ub(buffer_1, buffer_2, &printee);
-    break;
+  /* Fail before the computation if it does not fit into the budget. */
+  if (measure_.max_memory) {
+    ret = get_memory_needed(&measure_, buffer_1, buffer_2, &memory);
+#ifndef __linux__
+    memory += (double)mappings[0]->size + (double)mappings[1]->size;
+#endif
+    if ( !ret && memory > (double)measure_.max_memory ) {
+      fprintf(stderr, "Error: The computation needs about %.0f bytes of memory, "
+              "more than the budget.\n", memory);
+      ret = 1;
+    }
+    if (ret) {
+      cache_destroy(cache_);
+      buffer_unmap(buffer_2, mappings[1]);
+      buffer_unmap(buffer_1, mappings[0]);
+      return ret;
+    }
   }
-  buffer_destroy(buffer_2);
-  buffer_destroy(buffer_1);
+
+  if (all) {
+    ret = all_run(&measure_, buffer_1, buffer_2,
+                  settings_->thresholded ? settings_->threshold : SIZE_MAX, load_time);
+    cache_destroy(cache_);
+    buffer_unmap(buffer_2, mappings[1]);
+    buffer_unmap(buffer_1, mappings[0]);
+    return flush_output(ret);
+  }
+  if (settings_->units) {
+    ret = get_units_result(argv[0][1], settings_->units, buffer_1, buffer_2, results);
+  }
+  else if (profile_) {
+    if ( !cache_ ||
+         cache_find(cache_, &profile_->content, buffer_2, measure_key(&measure_), &printee) ) {
+      ret = get_profile_result(&measure_, profile_, buffer_2, &printee);
+      if (!ret && cache_) {
+        if ( cache_insert(cache_, &profile_->content, buffer_2, measure_key(&measure_), printee) ) {
+          fprintf(stderr, "Warning: Could not update cache.\n");
+        }
+      }
+    }
+  }
+  else if (settings_->explain) {
+    ret = get_planned_distance(measure_.metric, measure_.calibration_,
+                               measure_.max_memory, buffer_1, buffer_2, SIZE_MAX,
+                               stderr, &printee);
+  }
+  else {
+    ret = get_cached_result(cache_, &measure_, buffer_1, buffer_2, &printee);
+  }
+  cache_destroy(cache_);
+  buffer_unmap(buffer_2, mappings[1]);
+  buffer_unmap(buffer_1, mappings[0]);
+  profile_destroy(profile_);
   if (ret) {
     fprintf(stderr, "Error: Computation failed.\n");
     return ret;
   }
 
-  ret = printf(
-#ifdef _MSC_VER
-    "%Iu\n",
-#else
-    "%zu\n",
-#endif
-    printee);
+  if (settings_->units) {
+    ret = printf("%" SIZE_T_FORMAT " %" SIZE_T_FORMAT "\n", results[0], results[1]);
+  }
+  else {
+    ret = printf("%" SIZE_T_FORMAT "\n", printee);
+  }
   if (ret < 0) {
     fprintf(stderr, "Error: Could not print.\n");
     return 1;
@@ -568,4 +9593,77 @@ int main( int argc, char * argv[] ) {
 
   return 0;
 }
+
+int main( int argc, char * argv[] ) {
+  int ret = 0;
+  int argi = 1;
+  settings settings_ = {0};
+  command const * command_ = NULL;
+
+  ret = settings_parse(&settings_, &argi, argc, argv);
+  if (ret) {
+    return print_usage();
+  }
+
+  for (command_ = commands; argi < argc && command_->name; ++command_) {
+    if ( !strcmp(argv[argi], command_->name) ) {
+      if (settings_.batch_path || settings_.profile_path || settings_.units ||
+          settings_.explain || settings_.max_memory ||
+          settings_.cache_path && !command_->cached) {
+        return print_usage();
+      }
+      break;
+    }
+  }
+  if (argi == argc) {
+    return print_usage();
+  }
+
+  if (settings_.stats_format || settings_.trace_path) {
+#ifndef NO_STATS
+    ret = settings_.stats_format && stats_enable(settings_.perf) ||
+          settings_.trace_path && trace_enable();
+    if (ret) {
+      fprintf(stderr, "Error: Could not collect statistics.\n");
+      return ret;
+    }
+#else
+    fprintf(stderr, "Error: Statistics and traces are not supported by this build.\n");
+    return 1;
+#endif
+  }
+  if (settings_.costs_path) {
+    ret = costs_create(settings_.costs_path, &settings_.costs_);
+    if (ret) {
+      fprintf(stderr, "Error: Could not read costs.\n");
+      return ret;
+    }
+  }
+  if (settings_.calibration_path) {
+    ret = calibration_create(settings_.calibration_path, &settings_.calibration_);
+    if (ret) {
+      costs_destroy(settings_.costs_);
+      fprintf(stderr, "Error: Could not calibrate.\n");
+      return ret;
+    }
+  }
+  if (command_->name) {
+    ret = command_->run(&settings_, argc - argi, argv + argi);
+  }
+  else {
+    ret = command_compare(&settings_, argc - argi, argv + argi);
+  }
+  calibration_destroy(settings_.calibration_);
+  costs_destroy(settings_.costs_);
+#ifndef NO_STATS
+  if (settings_.stats_format) {
+    stats_print(settings_.stats_format);
+  }
+  if ( settings_.trace_path && trace_write(settings_.trace_path) ) {
+    fprintf(stderr, "Error: Could not write trace.\n");
+    ret = 1;
+  }
+#endif
+  return ret;
+}
 /* written by Frogger Fioz */